@@ -14,6 +14,10 @@ INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtWebSockets
 INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtNetwork
 INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtMultimedia
 
+# Gesture protocol headers shared with the relay server and hardware client
+INCLUDEPATH += $$PWD/../Airclass-Hardware/common
+DEPENDPATH += $$PWD/../Airclass-Hardware/common
+
 DEPENDPATH += $$[QT_INSTALL_HEADERS]/QtWebSockets
 DEPENDPATH += $$[QT_INSTALL_HEADERS]/QtNetwork
 DEPENDPATH += $$[QT_INSTALL_HEADERS]/QtMultimedia
@@ -40,7 +44,8 @@ SOURCES += \
     restapiclient.cpp \
     drawinglayer.cpp \
     udpdiscoveryserver.cpp \
-    gestureguide.cpp
+    gestureguide.cpp \
+    latencytracer.cpp
 
 
 HEADERS += \
@@ -59,7 +64,10 @@ HEADERS += \
     restapiclient.h \
     drawinglayer.h \
     udpdiscoveryserver.h \
-    gestureguide.h
+    gestureguide.h \
+    latencytracer.h \
+    ../Airclass-Hardware/common/gesture_commands.hpp \
+    ../Airclass-Hardware/common/gesture_frame.hpp
 
 
 FORMS += \
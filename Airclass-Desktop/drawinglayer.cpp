@@ -1,4 +1,5 @@
 #include "drawinglayer.h"
+#include "latencytracer.h"
 #include <QPainter>
 #include <QMouseEvent>
 
@@ -111,6 +112,7 @@ void DrawingLayer::drawRemotePoint(const QPointF &point, bool isStart)
     }
     m_currentPath.append(scaledPoint);
     update();
+    LatencyTracer::instance().actionApplied("drawRemotePoint");
 }
 
 void DrawingLayer::showPointer(double x, double y)
@@ -118,6 +120,7 @@ void DrawingLayer::showPointer(double x, double y)
     m_pointerPosition = scalePoint(QPointF(x, y));
     m_showPointer = true;
     update();
+    LatencyTracer::instance().actionApplied("showPointer");
 }
 
 void DrawingLayer::updateScrollPosition(const QPoint &scrollPos)
@@ -0,0 +1,149 @@
+#include "latencytracer.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+// Recent samples kept per stage for percentiles
+static const int SAMPLE_WINDOW = 512;
+// A gesture that has not led to an action within this time is not traced further
+static const qint64 MAX_ACTION_DELAY_NS = 2000LL * 1000 * 1000;
+// Report to the debug log every this many completed traces
+static const qint64 REPORT_EVERY = 50;
+
+// All calls happen on the GUI thread (WebSocketClient slots and the actions
+// they trigger), so no locking is needed.
+LatencyTracer &LatencyTracer::instance()
+{
+    static LatencyTracer tracer;
+    return tracer;
+}
+
+LatencyTracer::LatencyTracer()
+{
+    m_clock.start();
+}
+
+void LatencyTracer::gestureReceived(quint32 seq, const QString &command,
+                                    qint64 pipeUs, qint64 hardwareUs, qint64 relayUs)
+{
+    if (m_pending.active) {
+        m_unmatched++;  // Previous gesture had no traced action (e.g. an ignored command)
+    }
+    m_pending.active = true;
+    m_pending.seq = seq;
+    m_pending.command = command;
+    m_pending.pipeUs = pipeUs;
+    m_pending.hardwareUs = hardwareUs;
+    m_pending.relayUs = relayUs;
+    m_pending.receivedNs = m_clock.nsecsElapsed();
+}
+
+void LatencyTracer::actionApplied(const char *action)
+{
+    if (!m_pending.active) return;
+    m_pending.active = false;
+
+    const qint64 desktopNs = m_clock.nsecsElapsed() - m_pending.receivedNs;
+    if (desktopNs > MAX_ACTION_DELAY_NS) {
+        m_unmatched++;
+        return;
+    }
+
+    const qint64 desktopUs = desktopNs / 1000;
+    const qint64 networkUs = m_roundTripUs >= 0 ? m_roundTripUs / 2 : 0;
+    m_stages[CaptureToHardware].add(m_pending.pipeUs);
+    m_stages[Hardware].add(m_pending.hardwareUs);
+    m_stages[Relay].add(m_pending.relayUs);
+    m_stages[Network].add(networkUs);
+    m_stages[Desktop].add(desktopUs);
+    const qint64 totalUs = m_pending.pipeUs + m_pending.hardwareUs + m_pending.relayUs + networkUs + desktopUs;
+    m_stages[Total].add(totalUs);
+
+    qDebug() << "Gesture trace" << m_pending.seq << m_pending.command << "->" << action
+             << "total" << totalUs / 1000.0 << "ms";
+
+    if (m_stages[Total].count % REPORT_EVERY == 0) {
+        qInfo().noquote() << report();
+    }
+}
+
+void LatencyTracer::setRoundTripMs(qint64 roundTripMs)
+{
+    m_roundTripUs = roundTripMs * 1000;
+}
+
+QString LatencyTracer::report() const
+{
+    QString text;
+    QTextStream out(&text);
+    out << "Gesture latency (ms), " << m_stages[Total].count << " traced gestures, "
+        << m_unmatched << " without action\n";
+    out << QString("%1 %2 %3 %4 %5 %6\n")
+               .arg("stage", -22).arg("count", 7).arg("mean", 9)
+               .arg("p50", 9).arg("p95", 9).arg("max", 9);
+    for (int i = 0; i < StageCount; ++i) {
+        const StageStats &stats = m_stages[i];
+        const double mean = stats.count > 0 ? double(stats.sumUs) / stats.count / 1000.0 : 0.0;
+        out << QString("%1 %2 %3 %4 %5 %6\n")
+                   .arg(stageName(static_cast<Stage>(i)), -22)
+                   .arg(stats.count, 7)
+                   .arg(mean, 9, 'f', 2)
+                   .arg(stats.percentile(0.50) / 1000.0, 9, 'f', 2)
+                   .arg(stats.percentile(0.95) / 1000.0, 9, 'f', 2)
+                   .arg(stats.maxUs / 1000.0, 9, 'f', 2);
+    }
+    if (m_roundTripUs < 0) {
+        out << "(network not estimated yet: no ping round trip measured)\n";
+    }
+    return text;
+}
+
+bool LatencyTracer::dumpToFile(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append)) {
+        qWarning() << "Cannot write latency report to" << path;
+        return false;
+    }
+    QTextStream out(&file);
+    out << report() << "\n";
+    return true;
+}
+
+void LatencyTracer::StageStats::add(qint64 valueUs)
+{
+    if (valueUs < 0) valueUs = 0;
+    if (samples.size() < SAMPLE_WINDOW) {
+        samples.append(valueUs);
+    } else {
+        samples[next] = valueUs;
+        next = (next + 1) % SAMPLE_WINDOW;
+    }
+    count++;
+    sumUs += valueUs;
+    maxUs = std::max(maxUs, valueUs);
+}
+
+qint64 LatencyTracer::StageStats::percentile(double q) const
+{
+    if (samples.isEmpty()) return 0;
+    QVector<qint64> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    const int index = std::min(int(q * (sorted.size() - 1) + 0.5), int(sorted.size()) - 1);
+    return sorted[index];
+}
+
+QString LatencyTracer::stageName(Stage stage)
+{
+    switch (stage) {
+    case CaptureToHardware: return "capture -> hardware";
+    case Hardware:          return "hardware client";
+    case Relay:             return "relay";
+    case Network:           return "network (RTT/2)";
+    case Desktop:           return "desktop";
+    case Total:             return "total";
+    case StageCount:        break;
+    }
+    return "?";
+}
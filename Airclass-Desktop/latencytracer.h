@@ -0,0 +1,77 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// Aggregates the per-stage latency of traced gestures, from the camera frame
+// on the Pi to the action on this machine (e.g. PresentationManager::goToSlide).
+//
+// Stages measured on the Pi and the relay arrive with the gesture (hardware
+// client started with AIRCLASS_TRACE=1). The relay->desktop network leg cannot
+// be measured without synchronized clocks, so it is estimated as half the
+// WebSocket ping round trip. The desktop stage runs from receiving the message
+// to the action that handles it.
+class LatencyTracer
+{
+public:
+    enum Stage {
+        CaptureToHardware,  // Camera frame -> hardware client read it from the pipe
+        Hardware,           // Pipe read -> WebSocket send on the Pi
+        Relay,              // Relay receive -> fan-out
+        Network,            // Relay -> desktop, estimated as RTT / 2
+        Desktop,            // Message received -> action applied
+        Total,              // Sum of the above
+        StageCount
+    };
+
+    static LatencyTracer &instance();
+
+    // Called when a traced gesture arrives; the desktop stage starts here
+    void gestureReceived(quint32 seq, const QString &command,
+                         qint64 pipeUs, qint64 hardwareUs, qint64 relayUs);
+
+    // Called where a gesture takes effect; completes the pending trace, if any
+    void actionApplied(const char *action);
+
+    // Latest WebSocket ping round trip to the relay
+    void setRoundTripMs(qint64 roundTripMs);
+
+    // Human-readable table: count, mean, p50, p95 and max per stage
+    QString report() const;
+    bool dumpToFile(const QString &path) const;
+
+private:
+    LatencyTracer();
+
+    struct StageStats {
+        QVector<qint64> samples;  // Ring of the most recent values, in microseconds
+        int next = 0;
+        qint64 count = 0;
+        qint64 sumUs = 0;
+        qint64 maxUs = 0;
+        void add(qint64 valueUs);
+        qint64 percentile(double q) const;
+    };
+
+    struct PendingTrace {
+        bool active = false;
+        quint32 seq = 0;
+        QString command;
+        qint64 pipeUs = 0;
+        qint64 hardwareUs = 0;
+        qint64 relayUs = 0;
+        qint64 receivedNs = 0;
+    };
+
+    static QString stageName(Stage stage);
+
+    QElapsedTimer m_clock;
+    PendingTrace m_pending;
+    StageStats m_stages[StageCount];
+    qint64 m_roundTripUs = -1;   // -1 until the first pong
+    qint64 m_unmatched = 0;      // Traces that never reached an action
+};
+
+#endif // LATENCYTRACER_H
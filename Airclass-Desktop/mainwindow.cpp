@@ -34,6 +34,7 @@
 #include <QScrollBar>
 #include <QPdfPageNavigator>
 #include "gestureguide.h"
+#include "latencytracer.h"
 // Include UI header in implementation file, not in header
 #include "ui_mainwindow.h"
 #include "logindialog.h"
@@ -884,6 +885,24 @@ void MainWindow::setupConnections()
         showTimerDialog();
     });
 
+    // Gesture latency report (traced gestures only, see LatencyTracer)
+    QAction *actionLatencyReport = new QAction(tr("Latency Report"), this);
+    actionLatencyReport->setShortcut(QKeySequence("Ctrl+L"));
+    ui->menuView->addAction(actionLatencyReport);
+    addAction(actionLatencyReport); // Keep the shortcut active while the menu is hidden
+
+    connect(actionLatencyReport, &QAction::triggered, [this]() {
+        const QString report = LatencyTracer::instance().report();
+        qInfo().noquote() << report;
+        const QString traceFile = qEnvironmentVariable("AIRCLASS_TRACE_FILE");
+        if (!traceFile.isEmpty()) {
+            LatencyTracer::instance().dumpToFile(traceFile);
+        }
+        QMessageBox box(QMessageBox::Information, tr("Gesture Latency"), report, QMessageBox::Ok, this);
+        box.setStyleSheet("QLabel { font-family: monospace; }");
+        box.exec();
+    });
+
     // Connect presentation manager signals
     connect(m_presentationManager, &PresentationManager::error, [this](const QString &errorMessage) {
         QMessageBox::warning(this, tr("PDF Error"), errorMessage);
@@ -1,4 +1,5 @@
 #include "presentationmanager.h"
+#include "latencytracer.h"
 #include <QDebug>
 #include <QFileInfo>
 #include <QPdfPageNavigator>
@@ -278,6 +279,7 @@ void PresentationManager::goToSlide(int pageNumber)
 
             // Güvenli şekilde page indicators güncelle
             safeUpdatePageIndicators();
+            LatencyTracer::instance().actionApplied("goToSlide");
             qDebug() << "Changed to page:" << m_currentPage + 1 << "of" << m_document->pageCount();
         } else {
             qDebug() << "Invalid page number:" << pageNumber;
@@ -1,22 +1,27 @@
 #include "websocketclient.h"
+#include "latencytracer.h"
 #include <QDebug>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QTimer>
 
+#include "gesture_frame.hpp"
+
 WebSocketClient::WebSocketClient(QObject *parent)
     : QObject(parent),
     m_serverUrl("ws://localhost:8082"), // m_serverUrl önce başlatılmaya çalışılıyor
     m_connected(false),                  // m_connected sonra
     m_reconnectAttempts(0),
-    m_clientId("desktop-pi-01")  // Statik client ID
+    m_clientId("desktop-pi-01"),  // Statik client ID
+    m_room(qEnvironmentVariable("AIRCLASS_ROOM"))  // Relay room; empty = relay default
 
 {
     // Connect WebSocket signals to slots
     connect(&m_webSocket, &QWebSocket::connected, this, &WebSocketClient::onConnected);
     connect(&m_webSocket, &QWebSocket::disconnected, this, &WebSocketClient::onDisconnected);
     connect(&m_webSocket, &QWebSocket::textMessageReceived, this, &WebSocketClient::onTextMessageReceived);
+    connect(&m_webSocket, &QWebSocket::binaryMessageReceived, this, &WebSocketClient::onBinaryMessageReceived);
     connect(&m_webSocket, &QWebSocket::errorOccurred, this, &WebSocketClient::onError);
     connect(&m_webSocket, &QWebSocket::pong, this, &WebSocketClient::onPong);
 
@@ -138,6 +143,17 @@ void WebSocketClient::onConnected()
     QJsonObject registrationMsg;
     registrationMsg["register"] = "desktop";
     registrationMsg["id"] = m_clientId;
+    if (!m_room.isEmpty()) {
+        registrationMsg["room"] = m_room;  // Only receive gestures from this classroom
+    }
+    registrationMsg["binary"] = int(airclass::kFrameVersion);  // Accept compact gesture frames
+    registrationMsg["batch"] = true;  // Several frames per message when they arrive together
+    if (m_lastRelaySeq > 0 && !m_relayEpoch.isEmpty()) {
+        // Reconnecting: the relay replays the commands we missed since then,
+        // if it still has the replay log that sequence comes from
+        registrationMsg["last_seq"] = static_cast<qint64>(m_lastRelaySeq);
+        registrationMsg["epoch"] = m_relayEpoch;
+    }
 
     QJsonDocument doc(registrationMsg);
     QString message = doc.toJson(QJsonDocument::Compact);
@@ -199,6 +215,7 @@ void WebSocketClient::onPong(quint64 elapsedTime, const QByteArray &payload)
     // Optionally, you can handle the pong response here
     // For example, you could log it or emit a signal
     // emit pongReceived(elapsedTime, payload);
+    LatencyTracer::instance().setRoundTripMs(static_cast<qint64>(elapsedTime));
     m_pingTimer.start(); // Restart ping timer if needed
 }
 
@@ -215,9 +232,47 @@ void WebSocketClient::onTextMessageReceived(const QString &message)
 
     QJsonObject obj = doc.object();
 
+    if (obj["type"].toString() == "registration_success" && !obj.contains("rseq")) {
+        // Relay without a replay log: its commands carry no rseq
+        m_lastRelaySeq = 0;
+        m_relayEpoch.clear();
+    }
+    if (obj["type"].toString() == "registration_success" && obj.contains("rseq")) {
+        const quint64 head = static_cast<quint64>(obj["rseq"].toDouble());
+        const QString epoch = obj["epoch"].toString();
+        if (epoch != m_relayEpoch || head < m_lastRelaySeq) {
+            // Another relay, or a new replay log: its sequence space starts at
+            // head, and nothing from it was replayed to us
+            m_lastRelaySeq = head;
+            m_relayEpoch = epoch;
+        }
+        if (obj["replay_truncated"].toBool()) {
+            qWarning() << "Relay could not replay every missed command; presentation state may be stale";
+        }
+        qDebug() << "Relay replaying" << obj["replayed"].toInt() << "missed command(s)";
+    }
+
     // Komut mesajları için
     if (obj.contains("command")) {
         QString command = obj["command"].toString();
+        if (obj.contains("rseq") && !acceptRelaySeq(static_cast<quint64>(obj["rseq"].toDouble()))) {
+            return;
+        }
+        if (obj.contains("seq") && obj.contains("capture_us")
+            && !acceptGesture(static_cast<quint32>(obj["seq"].toDouble()),
+                              static_cast<quint64>(obj["capture_us"].toDouble()))) {
+            return;
+        }
+
+        // Traced gesture (AIRCLASS_TRACE on the Pi): per-hop durations so far
+        if (obj.contains("trace")) {
+            QJsonObject trace = obj["trace"].toObject();
+            LatencyTracer::instance().gestureReceived(
+                static_cast<quint32>(obj["seq"].toDouble()), command,
+                static_cast<qint64>(trace["pipe_us"].toDouble()),
+                static_cast<qint64>(trace["hw_us"].toDouble()),
+                static_cast<qint64>(trace["relay_us"].toDouble()));
+        }
 
         if (command == "two_up" || command == "one_up") {
             // Position bilgisi içeren komutlar için
@@ -264,6 +319,83 @@ void WebSocketClient::onTextMessageReceived(const QString &message)
     emit messageReceived(message);
 }
 
+// Compact gesture frames (see gesture_frame.hpp), sent by the relay instead of
+// the JSON command message once we registered with "binary". With "batch" a
+// message may carry several frames, handled in order.
+void WebSocketClient::onBinaryMessageReceived(const QByteArray &message)
+{
+    const std::size_t length = static_cast<std::size_t>(message.size());
+    if (airclass::isBatch(message.constData(), length)) {
+        const bool complete = airclass::forEachInBatch(message.constData(), length,
+            [this](const unsigned char *frame, std::size_t frameLength) {
+                handleFrame(frame, frameLength);
+            });
+        if (!complete) {
+            qWarning() << "Malformed gesture batch received, size:" << message.size();
+        }
+        return;
+    }
+    handleFrame(message.constData(), length);
+}
+
+void WebSocketClient::handleFrame(const void *data, std::size_t length)
+{
+    airclass::GestureFrame frame;
+    if (!airclass::decodeFrame(data, length, frame)) {
+        qWarning() << "Invalid binary gesture frame received, size:" << length;
+        return;
+    }
+
+    if (frame.hasRelaySeq() && !acceptRelaySeq(frame.relay_seq)) {
+        return;
+    }
+    if (!acceptGesture(frame.seq, frame.capture_us)) {
+        return;
+    }
+
+    const std::string_view name = airclass::commandName(frame.command);
+    const QString command = QString::fromLatin1(name.data(), static_cast<qsizetype>(name.size()));
+    if (frame.hasTrace()) {
+        LatencyTracer::instance().gestureReceived(frame.seq, command, frame.pipe_us, frame.hw_us, frame.relay_us);
+    }
+    if (frame.hasPosition() && frame.command == airclass::CommandType::TWO_UP) {
+        qDebug() << "Received command:" << command << "with position x:" << frame.x << "y:" << frame.y;
+        emit gestureReceived(command, QString::number(frame.x), QString::number(frame.y));
+    }
+    else {
+        qDebug() << "Received command:" << command;
+        emit gestureReceived(command, "", "");
+    }
+}
+
+// Commands logged by the relay carry its sequence number. Remembers the newest
+// one and rejects anything already handled (a replay overlapping live traffic).
+bool WebSocketClient::acceptRelaySeq(quint64 rseq)
+{
+    if (rseq <= m_lastRelaySeq) {
+        qDebug() << "Skipping already handled command, rseq" << rseq;
+        return false;
+    }
+    m_lastRelaySeq = rseq;
+    return true;
+}
+
+// A hardware client publishing to several relays (active-active) sends every
+// gesture with the same seq and capture time to each. Rejects one already
+// handled among the last few, however it arrived.
+bool WebSocketClient::acceptGesture(quint32 seq, quint64 captureUs)
+{
+    for (const GestureKey &key : m_recentGestures) {
+        if (key.seq == seq && key.captureUs == captureUs && captureUs != 0) {
+            qDebug() << "Skipping duplicate gesture, seq" << seq;
+            return false;
+        }
+    }
+    m_recentGestures[m_recentGestureNext] = {seq, captureUs};
+    m_recentGestureNext = (m_recentGestureNext + 1) % m_recentGestures.size();
+    return true;
+}
+
 void WebSocketClient::onError(QAbstractSocket::SocketError error)
 {
     Q_UNUSED(error);
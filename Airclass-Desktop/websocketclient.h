@@ -9,6 +9,8 @@
 #include <QTimer>
 #include <QWebSocket>
 
+#include <array>
+#include <cstddef>
 
 #define PING_INTERVAL 30000 // 30 seconds
 #define RECONNECT_INTERVAL 5000 // 5 seconds
@@ -42,19 +44,36 @@ private slots:
     void onConnected();
     void onDisconnected();
     void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
     void onError(QAbstractSocket::SocketError error);
     void onPong(quint64 elapsedTime, const QByteArray &payload);
     void sendPing();
     void tryReconnect();
 
 private:
+    void handleFrame(const void *data, std::size_t length);
+    bool acceptRelaySeq(quint64 rseq);
+    bool acceptGesture(quint32 seq, quint64 captureUs);
+
     QWebSocket m_webSocket;
     bool m_connected;
     QString m_serverUrl;
     QString m_clientId;
+    QString m_room;
     QTimer m_pingTimer;
     QTimer m_reconnectTimer;
     int m_reconnectAttempts;
+    quint64 m_lastRelaySeq = 0;  // Newest relay sequence handled; sent on reconnect to catch up
+    QString m_relayEpoch;        // Replay log m_lastRelaySeq belongs to (empty = none)
+
+    // Recently handled gestures by hardware seq and capture time, to drop the
+    // second copy when the hardware publishes to several relays
+    struct GestureKey {
+        quint32 seq = 0;
+        quint64 captureUs = 0;
+    };
+    std::array<GestureKey, 64> m_recentGestures{};
+    std::size_t m_recentGestureNext = 0;
 
 };
 
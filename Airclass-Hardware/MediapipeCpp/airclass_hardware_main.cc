@@ -0,0 +1,83 @@
+// AirClass – in-process hardware client.
+//
+// One process instead of the recogniser + named pipe + hardware_client chain:
+// GestureEngine runs the MediaPipe graph and classification on this thread
+// and hands each CommandType straight to RelayPublisher, which sends it to
+// the relay(s) (as a binary gesture frame once the relay accepted it). No
+// JSON line is written, read or parsed, and no pipe sits between camera and
+// socket.
+//
+// Takes the same arguments and AIRCLASS_* environment as hardware_client:
+//   airclass_hardware [ws://relay:8080[,ws://backup:8080]] [clientId] [room]
+// plus AIRCLASS_SHOW_VIDEO=0 to run headless (no window, no rendering).
+// Stops on SIGINT/SIGTERM, or ESC in the video window.
+
+#include "gesture_engine.h"
+
+#include "mediapipe/framework/port/logging.h"
+
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Relay connection(s), shared with hardware_client
+#include "relay_publisher.hpp"
+
+namespace {
+
+airclass::GestureEngine* g_engine = nullptr;
+
+void RequestStop(int) {
+  if (g_engine != nullptr) g_engine->Stop();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = 1;
+
+  RelayOptions relay_options;
+  if (!readRelayOptions(argc, argv, relay_options)) {
+    AC_LOG(Error) << "FATAL: No server URI given. Exiting.";
+    return EXIT_FAILURE;
+  }
+  airclass::GestureEngineOptions engine_options;
+  if (const char* env_show = std::getenv("AIRCLASS_SHOW_VIDEO")) {
+    engine_options.show_window = std::string(env_show) != "0";
+  }
+
+  AC_LOG(Info) << "--- AirClass Hardware (in-process recogniser) ---";
+  logRelayOptions(relay_options);
+  AC_LOG(Info) << "Video     : " << (engine_options.show_window ? "window" : "headless");
+
+  // Connects in the background; commands are spooled until a relay is up.
+  RelayPublisher relays(relay_options);
+  relays.connect();
+
+  airclass::GestureEngine engine(engine_options);
+  g_engine = &engine;
+  std::signal(SIGINT, RequestStop);
+  std::signal(SIGTERM, RequestStop);
+
+  const absl::Status status = engine.Run(
+      [&relays](airclass::CommandType command, int64_t capture_us) {
+        // Recognition time shows up as the pipe hop in latency traces.
+        CommandTrace trace;
+        trace.capture_us = static_cast<std::uint64_t>(capture_us);
+        trace.read_us = steadyNowUs();
+        if (!relays.send(command, json(), trace)) {
+          AC_LOG_RATE(Warn, 5) << "Failed to send command: " << airclass::commandName(command);
+        }
+      });
+
+  g_engine = nullptr;
+  relays.stop();
+  if (!status.ok()) {
+    LOG(ERROR) << "Gesture engine failed: " << status;
+    return EXIT_FAILURE;
+  }
+  AC_LOG(Info) << "AirClass hardware finished.";
+  return EXIT_SUCCESS;
+}
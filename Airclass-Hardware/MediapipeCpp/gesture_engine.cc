@@ -0,0 +1,323 @@
+// AirClass – MediaPipe gesture engine (see gesture_engine.h).
+// Packet timestamps for MediaPipe are based on a monotonic clock.
+
+#include "gesture_engine.h"
+
+#include "mediapipe/framework/calculator_graph.h"
+#include "mediapipe/framework/formats/image_frame.h"
+#include "mediapipe/framework/formats/landmark.pb.h"
+#include "mediapipe/framework/port/file_helpers.h"
+#include "mediapipe/framework/port/logging.h"
+#include "mediapipe/framework/port/status.h"
+
+#include "mediapipe/framework/formats/image_format.pb.h"
+#include "mediapipe/framework/formats/image_frame_opencv.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+#include "mediapipe/framework/port/opencv_highgui_inc.h"
+
+#include <google/protobuf/text_format.h>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace airclass {
+namespace {
+
+namespace mp = mediapipe;
+
+/* ---------- classification ---------- */
+
+// The Gesture enum represents the basic hand poses we recognise.
+enum class Gesture { kUnknown, kThumbsUp, kThumbsDown, kOpenPalm, kClosedPalm };
+
+// A fingertip is considered extended when its y-coordinate is above the PIP joint.
+inline bool finger_extended(const mp::NormalizedLandmark& tip,
+                            const mp::NormalizedLandmark& pip) {
+  return tip.y() < pip.y();
+}
+
+// The classify function interprets a list of 21 hand landmarks into one of the Gesture values.
+Gesture classify(const mp::NormalizedLandmarkList& lm) {
+  if (lm.landmark_size() < 21) {
+    // If there aren’t enough landmarks, the gesture cannot be determined.
+    return Gesture::kUnknown;
+  }
+  const auto& wrist = lm.landmark(0);
+  const auto& thumb_tip = lm.landmark(4);
+  const auto& thumb_ip  = lm.landmark(3);
+
+  // Count how many of the four fingers (index through pinky) are extended.
+  int extended_count =
+      finger_extended(lm.landmark(8),  lm.landmark(6))  +
+      finger_extended(lm.landmark(12), lm.landmark(10)) +
+      finger_extended(lm.landmark(16), lm.landmark(14)) +
+      finger_extended(lm.landmark(20), lm.landmark(18));
+
+  bool thumb_up   = finger_extended(thumb_tip, thumb_ip) && (thumb_tip.y() < wrist.y());
+  bool thumb_down = !finger_extended(thumb_tip, thumb_ip) && (thumb_tip.y() > wrist.y());
+
+  if (thumb_up   && extended_count == 0) return Gesture::kThumbsUp;
+  if (thumb_down && extended_count == 0) return Gesture::kThumbsDown;
+  if (extended_count >= 4)               return Gesture::kOpenPalm;
+  if (extended_count == 0)               return Gesture::kClosedPalm;
+  return Gesture::kUnknown;
+}
+
+// Command a single-hand gesture triggers while ACTIVE.
+CommandType command_for(Gesture gesture) {
+  switch (gesture) {
+    case Gesture::kThumbsUp:   return CommandType::LIKE;     // ACCEPT
+    case Gesture::kThumbsDown: return CommandType::DISLIKE;  // REJECT
+    case Gesture::kOpenPalm:   return CommandType::RIGHT;
+    case Gesture::kClosedPalm: return CommandType::LEFT;
+    default:                   return CommandType::UNKNOWN;
+  }
+}
+
+}  // namespace
+
+GestureEngine::GestureEngine(GestureEngineOptions options)
+    : options_(std::move(options)) {}
+
+absl::Status GestureEngine::Run(const CommandCallback& on_command) {
+  stop_requested_.store(false);
+
+  // The graph configuration text is read from its PBtxt file on disk.
+  std::string graph_txt;
+  auto status = mp::file::GetContents(options_.graph_path, &graph_txt);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to load graph config from " << options_.graph_path << ": " << status;
+    return status;
+  }
+  LOG(INFO) << "Graph configuration loaded.";
+
+  mp::CalculatorGraphConfig cfg;
+  if (!google::protobuf::TextFormat::ParseFromString(graph_txt, &cfg)) {
+    return absl::InvalidArgumentError("Failed to parse graph configuration.");
+  }
+
+  mp::CalculatorGraph graph;
+  status = graph.Initialize(cfg);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to initialize graph: " << status;
+    return status;
+  }
+  LOG(INFO) << "MediaPipe graph initialized.";
+
+  // The camera is opened, and the driver’s internal buffer is limited to one frame.
+  LOG(INFO) << "Opening camera device " << options_.camera_index << "...";
+  cv::VideoCapture cam(options_.camera_index);
+  if (!cam.isOpened()) {
+    return absl::UnavailableError("Cannot open camera device " +
+                                  std::to_string(options_.camera_index) + ".");
+  }
+  if (!cam.set(cv::CAP_PROP_BUFFERSIZE, 1)) {
+    LOG(WARNING) << "Could not limit camera buffer size; some queuing may occur.";
+  }
+  cam.set(cv::CAP_PROP_FRAME_WIDTH, options_.width);
+  cam.set(cv::CAP_PROP_FRAME_HEIGHT, options_.height);
+
+  const int cam_width  = static_cast<int>(cam.get(cv::CAP_PROP_FRAME_WIDTH));
+  const int cam_height = static_cast<int>(cam.get(cv::CAP_PROP_FRAME_HEIGHT));
+  LOG(INFO) << "Camera ready at resolution: " << cam_width << "x" << cam_height;
+
+  // Pollers are created to pull landmarks and, when shown, rendered video from the graph.
+  auto landmark_poller_or = graph.AddOutputStreamPoller("landmarks");
+  if (!landmark_poller_or.ok()) {
+    LOG(ERROR) << "Failed to add poller for landmarks: " << landmark_poller_or.status();
+    return landmark_poller_or.status();
+  }
+  auto landmark_poller = std::move(landmark_poller_or.value());
+
+  std::optional<mp::OutputStreamPoller> video_poller;
+  if (options_.show_window) {
+    auto video_poller_or = graph.AddOutputStreamPoller("output_video");
+    if (!video_poller_or.ok()) {
+      LOG(ERROR) << "Failed to add poller for output_video: " << video_poller_or.status();
+      return video_poller_or.status();
+    }
+    video_poller.emplace(std::move(video_poller_or.value()));
+  }
+
+  // The graph is started, ready to process incoming frames.
+  status = graph.StartRun({});
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to start graph run: " << status;
+    return status;
+  }
+  LOG(INFO) << "Graph run started.";
+
+  bool active = false;
+  bool last_both_up = false;
+
+  const std::string window_name = "AirClass Output";
+  if (options_.show_window) {
+    cv::namedWindow(window_name, /*flags=*/0);
+  }
+
+  // Variables for FPS computation.
+  auto fps_start_time = std::chrono::steady_clock::now();
+  int frame_count = 0;
+  double display_fps = 0.0;
+
+  // A cooldown timer ensures a minimum gap between any two actions.
+  auto last_action_time = std::chrono::steady_clock::now() - options_.cooldown - std::chrono::seconds(1);
+
+  absl::Status result = absl::OkStatus();
+  LOG(INFO) << "Entering main loop" << (options_.show_window ? " (press ESC to exit)" : "") << "...";
+  while (!stop_requested_.load()) {
+    // A fresh camera frame is grabbed here.
+    cv::Mat frame_bgr;
+    cam >> frame_bgr;
+    if (frame_bgr.empty()) {
+      LOG(WARNING) << "Empty frame received from camera.";
+      if (!cam.isOpened()) {
+        result = absl::UnavailableError("Camera appears to be disconnected.");
+        break;
+      }
+      if (options_.show_window) cv::waitKey(1);
+      continue;
+    }
+
+    // The frame is wrapped into a MediaPipe ImageFrame and sent to the graph.
+    auto input_frame = std::make_unique<mp::ImageFrame>(
+        mp::ImageFormat::SRGB, frame_bgr.cols, frame_bgr.rows,
+        mp::ImageFrame::kDefaultAlignmentBoundary);
+    cv::Mat input_mat = mp::formats::MatView(input_frame.get());
+    cv::cvtColor(frame_bgr, input_mat, cv::COLOR_BGR2RGB);
+
+    // Packet timestamps use the monotonic steady_clock to avoid any system-time jumps.
+    auto now_tp = std::chrono::steady_clock::now();
+    int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         now_tp.time_since_epoch())
+                         .count();
+    mp::Timestamp timestamp(now_us);
+
+    status = graph.AddPacketToInputStream(
+        "input_video", mp::Adopt(input_frame.release()).At(timestamp));
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to add packet to input stream: " << status;
+      result = status;
+      break;
+    }
+
+    // The landmark poller is drained so only the most recent set is used.
+    std::vector<Gesture> gestures;
+    int64_t gestures_capture_us = now_us;  // Frame time of the landmarks used below.
+    if (landmark_poller.QueueSize() > 0) {
+      mp::Packet packet;
+      int n = landmark_poller.QueueSize();
+      for (int i = 0; i < n - 1; ++i) {
+        landmark_poller.Next(&packet);
+      }
+      if (landmark_poller.Next(&packet)) {
+        gestures_capture_us = packet.Timestamp().Value();
+        const auto& hand_lists =
+            packet.Get<std::vector<mp::NormalizedLandmarkList>>();
+        for (const auto& lm : hand_lists) {
+          gestures.push_back(classify(lm));
+        }
+      }
+    }
+
+    // The video poller is drained so only the newest rendered frame is shown.
+    cv::Mat graph_output_bgr;
+    bool got_video = false;
+    if (video_poller && video_poller->QueueSize() > 0) {
+      mp::Packet packet;
+      int m = video_poller->QueueSize();
+      for (int i = 0; i < m - 1; ++i) {
+        video_poller->Next(&packet);
+      }
+      if (video_poller->Next(&packet)) {
+        const auto& output_frame = packet.Get<mp::ImageFrame>();
+        cv::Mat output_mat = mp::formats::MatView(&output_frame);
+        cv::cvtColor(output_mat, graph_output_bgr, cv::COLOR_RGB2BGR);
+        got_video = true;
+      }
+    }
+
+    // Gesture logic runs only if the cooldown has expired.
+    bool in_cooldown = std::chrono::steady_clock::now() < (last_action_time + options_.cooldown);
+    bool current_both_up = (gestures.size() == 2 &&
+                            gestures[0] == Gesture::kThumbsUp &&
+                            gestures[1] == Gesture::kThumbsUp);
+    if (!in_cooldown) {
+      bool did_action = false;
+
+      // A transition into two-thumbs-up toggles the ACTIVE state.
+      if (current_both_up && !last_both_up) {
+        active = !active;
+        std::cout << "\n=== SYSTEM " << (active ? "ACTIVATED" : "PASSIVE") << " ===\n";
+        did_action = true;
+      }
+      // When ACTIVE, a single hand triggers one of four commands.
+      else if (active && gestures.size() == 1 && !current_both_up) {
+        const CommandType command = command_for(gestures[0]);
+        if (command != CommandType::UNKNOWN) {
+          std::cout << "Command: " << commandName(command) << "\n";
+          on_command(command, gestures_capture_us);
+          did_action = true;
+        }
+      }
+      if (did_action) {
+        last_action_time = std::chrono::steady_clock::now();
+      }
+    }
+
+    // The transition state is updated so we can catch activation toggles next frame.
+    last_both_up = current_both_up;
+
+    if (!options_.show_window) continue;
+
+    // Choose the freshest frame for display.
+    cv::Mat display_frame = got_video ? graph_output_bgr : frame_bgr;
+
+    // Update and overlay the FPS counter.
+    frame_count++;
+    auto fps_now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(fps_now - fps_start_time).count();
+    if (elapsed >= 1.0) {
+      display_fps = frame_count / elapsed;
+      fps_start_time = fps_now;
+      frame_count = 0;
+    }
+    if (!display_frame.empty()) {
+      std::ostringstream ss;
+      ss << std::fixed << std::setprecision(1) << display_fps;
+      cv::putText(display_frame, "FPS: " + ss.str(), {10, 30},
+                  cv::FONT_HERSHEY_SIMPLEX, 0.8, {0, 255, 0}, 2);
+      if (in_cooldown) {
+        cv::putText(display_frame, "COOLDOWN", {10, 60},
+                    cv::FONT_HERSHEY_SIMPLEX, 0.6, {0, 0, 255}, 2);
+      }
+      cv::imshow(window_name, display_frame);
+    }
+
+    // Pressing ESC exits the main loop.
+    if (cv::waitKey(5) == 27) {
+      LOG(INFO) << "ESC pressed, exiting.";
+      break;
+    }
+  }
+
+  // Cleanup of streams and graph shutdown.
+  graph.CloseAllPacketSources().IgnoreError();
+  graph.WaitUntilDone().IgnoreError();
+  if (options_.show_window) {
+    cv::destroyWindow(window_name);
+  }
+  if (cam.isOpened()) {
+    cam.release();
+  }
+  return result;
+}
+
+}  // namespace airclass
@@ -0,0 +1,65 @@
+// AirClass – MediaPipe gesture engine.
+//
+// Runs the hand-tracking graph on camera frames, classifies the landmarks of
+// every hand and turns them into commands: a two-hand thumbs-up toggles
+// ACTIVE / PASSIVE, and while ACTIVE a single-hand gesture emits one of four
+// commands, at most one per cooldown. Commands are handed to a callback as
+// airclass::CommandType together with the capture time of the frame they were
+// recognised in (steady_clock microseconds, the packet timestamp).
+//
+// Used by the standalone recogniser (airclass_hand_detection_main.cc, which
+// writes the commands to the hardware client's pipe) and by the in-process
+// hardware client (airclass_hardware_main.cc, which publishes them directly).
+
+#ifndef AIRCLASS_GESTURE_ENGINE_H_
+#define AIRCLASS_GESTURE_ENGINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "absl/status/status.h"
+#include "gesture_commands.hpp"
+
+namespace airclass {
+
+struct GestureEngineOptions {
+  // Hand-tracking graph, relative to the MediaPipe workspace root.
+  std::string graph_path =
+      "mediapipe/graphs/hand_tracking/hand_tracking_desktop_live.pbtxt";
+  int camera_index = 0;
+  int width = 640;
+  int height = 480;
+  // Shows the annotated video with an FPS counter; ESC stops the engine.
+  // Headless runs skip rendering the output frames altogether.
+  bool show_window = true;
+  // Minimum time between two gesture-driven actions.
+  std::chrono::milliseconds cooldown{3000};
+};
+
+class GestureEngine {
+ public:
+  // Called on the thread running Run() for every recognised command.
+  using CommandCallback =
+      std::function<void(CommandType command, int64_t capture_us)>;
+
+  explicit GestureEngine(GestureEngineOptions options);
+
+  // Opens the camera, starts the graph and processes frames until Stop(),
+  // ESC in the window or a camera failure.
+  absl::Status Run(const CommandCallback& on_command);
+
+  // Makes Run() return after the current frame. Safe from any thread and
+  // from a signal handler.
+  void Stop() { stop_requested_.store(true); }
+
+ private:
+  const GestureEngineOptions options_;
+  std::atomic<bool> stop_requested_{false};
+};
+
+}  // namespace airclass
+
+#endif  // AIRCLASS_GESTURE_ENGINE_H_
@@ -0,0 +1,361 @@
+// Asynchronous logger shared by the relay server and the hardware client.
+//
+// Call sites format into a fixed-size stack buffer and push the finished line
+// into a lock-free multi-producer ring. A background writer thread drains the
+// ring and does the actual console I/O, so hot paths never block on stdout.
+//
+// Usage:
+//   AC_LOG(Info) << "Client registered: ID=" << id;
+//   AC_LOG_RATE(Warn, 5) << "Send error: " << e.what();   // at most ~5 lines/s
+//
+// The threshold comes from AIRCLASS_LOG_LEVEL (debug, info, warn, error, off)
+// and defaults to info. Arguments of a disabled statement are not evaluated.
+
+#ifndef AIRCLASS_LOG_HPP
+#define AIRCLASS_LOG_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+namespace airclass {
+namespace logging {
+
+enum class Level : int { Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4 };
+
+constexpr std::size_t kLineCapacity = 240;    // Bytes of text kept per log line
+constexpr std::size_t kRingCapacity = 2048;   // Queued lines (power of two)
+
+// Parses a level name as used in AIRCLASS_LOG_LEVEL; unknown names mean Info
+inline Level parseLevel(const char* name) {
+    if (name == nullptr) return Level::Info;
+    std::string_view value(name);
+    if (value == "debug") return Level::Debug;
+    if (value == "info")  return Level::Info;
+    if (value == "warn")  return Level::Warn;
+    if (value == "error") return Level::Error;
+    if (value == "off")   return Level::Off;
+    return Level::Info;
+}
+
+// Process-wide threshold, initialised once from the environment
+inline std::atomic<int>& threshold() {
+    static std::atomic<int> level{static_cast<int>(parseLevel(std::getenv("AIRCLASS_LOG_LEVEL")))};
+    return level;
+}
+
+inline bool enabled(Level level) {
+    return static_cast<int>(level) >= threshold().load(std::memory_order_relaxed);
+}
+
+inline void setLevel(Level level) {
+    threshold().store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+// A finished log line as it travels through the ring
+struct Record {
+    Level level = Level::Info;
+    std::int64_t wall_us = 0;        // Wall-clock time the line was produced
+    std::uint32_t suppressed = 0;    // Lines dropped by rate limiting just before this one
+    std::uint16_t length = 0;
+    char text[kLineCapacity];
+};
+
+// Bounded MPSC ring (Vyukov-style sequence numbers per slot). Producers never
+// block: when the ring is full the line is dropped and counted instead.
+class RecordRing {
+public:
+    RecordRing() {
+        for (std::size_t i = 0; i < kRingCapacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(const Record& record) {
+        std::size_t pos = m_head.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        for (;;) {
+            slot = &m_slots[pos & (kRingCapacity - 1)];
+            std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->record.level = record.level;
+        slot->record.wall_us = record.wall_us;
+        slot->record.suppressed = record.suppressed;
+        slot->record.length = record.length;
+        std::memcpy(slot->record.text, record.text, record.length);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Single consumer only (the writer thread)
+    bool tryPop(Record& out) {
+        Slot& slot = m_slots[m_tail & (kRingCapacity - 1)];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(m_tail + 1) < 0) {
+            return false;  // Empty
+        }
+        out.level = slot.record.level;
+        out.wall_us = slot.record.wall_us;
+        out.suppressed = slot.record.suppressed;
+        out.length = slot.record.length;
+        std::memcpy(out.text, slot.record.text, out.length);
+        slot.sequence.store(m_tail + kRingCapacity, std::memory_order_release);
+        ++m_tail;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence{0};
+        Record record;
+    };
+
+    alignas(64) std::atomic<std::size_t> m_head{0};  // Next slot to claim (producers)
+    alignas(64) std::size_t m_tail = 0;              // Next slot to read (writer)
+    Slot m_slots[kRingCapacity];
+};
+
+// Owns the ring and the background writer thread
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    void submit(const Record& record) {
+        bool pushed = m_ring.tryPush(record);
+        // Warnings and errors are worth a short wait for the writer to make room
+        for (int attempt = 0; !pushed && record.level >= Level::Warn && attempt < 100; ++attempt) {
+            m_wake.notify_one();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            pushed = m_ring.tryPush(record);
+        }
+        if (!pushed) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (m_writerIdle.load(std::memory_order_acquire)) {
+            m_wake.notify_one();
+        }
+    }
+
+    ~Logger() {
+        m_stop.store(true, std::memory_order_release);
+        m_wake.notify_one();
+        if (m_writer.joinable()) {
+            m_writer.join();
+        }
+    }
+
+private:
+    Logger() : m_writer(&Logger::writerLoop, this) {}
+
+    void writerLoop() {
+        Record record;
+        for (;;) {
+            bool wrote = false;
+            while (m_ring.tryPop(record)) {
+                write(record);
+                wrote = true;
+            }
+            std::uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                std::fprintf(stderr, "[log] %llu line(s) dropped, logger ring was full\n",
+                             static_cast<unsigned long long>(dropped));
+                wrote = true;
+            }
+            if (wrote) {
+                std::fflush(stdout);
+                std::fflush(stderr);
+                continue;
+            }
+            if (m_stop.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            // Nothing queued: sleep until a producer signals or a short timeout passes
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_writerIdle.store(true, std::memory_order_release);
+            m_wake.wait_for(lock, std::chrono::milliseconds(10));
+            m_writerIdle.store(false, std::memory_order_release);
+        }
+    }
+
+    static void write(const Record& record) {
+        static const char* const kNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR", "OFF  "};
+        std::FILE* out = record.level >= Level::Warn ? stderr : stdout;
+
+        std::time_t seconds = static_cast<std::time_t>(record.wall_us / 1000000);
+        std::tm local{};
+        localtime_r(&seconds, &local);
+        if (record.suppressed > 0) {
+            std::fprintf(out, "%02d:%02d:%02d.%03d %s (%u similar line(s) suppressed)\n",
+                         local.tm_hour, local.tm_min, local.tm_sec,
+                         static_cast<int>((record.wall_us / 1000) % 1000),
+                         kNames[static_cast<int>(record.level)], record.suppressed);
+        }
+        std::fprintf(out, "%02d:%02d:%02d.%03d %s %.*s\n",
+                     local.tm_hour, local.tm_min, local.tm_sec,
+                     static_cast<int>((record.wall_us / 1000) % 1000),
+                     kNames[static_cast<int>(record.level)],
+                     static_cast<int>(record.length), record.text);
+    }
+
+    RecordRing m_ring;
+    std::atomic<std::uint64_t> m_dropped{0};
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_writerIdle{false};
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    std::thread m_writer;  // Declared last so it starts after the members above
+};
+
+// Token bucket used by AC_LOG_RATE; one instance per call site
+class RateLimiter {
+public:
+    explicit RateLimiter(double perSecond)
+        : m_perSecond(perSecond > 0 ? perSecond : 1)
+        , m_tokens(m_perSecond)
+        , m_last(std::chrono::steady_clock::now()) {}
+
+    bool allow() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - m_last).count();
+        m_last = now;
+        m_tokens = std::min(m_perSecond, m_tokens + elapsed * m_perSecond);
+        if (m_tokens < 1.0) {
+            ++m_suppressed;
+            return false;
+        }
+        m_tokens -= 1.0;
+        return true;
+    }
+
+    std::uint32_t takeSuppressed() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::uint32_t count = m_suppressed;
+        m_suppressed = 0;
+        return count;
+    }
+
+private:
+    std::mutex m_mutex;
+    const double m_perSecond;
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_last;
+    std::uint32_t m_suppressed = 0;
+};
+
+// Builds one log line on the stack and submits it when the statement ends
+class Line {
+public:
+    explicit Line(Level level, std::uint32_t suppressed = 0) {
+        m_record.level = level;
+        m_record.suppressed = suppressed;
+        m_record.wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    ~Line() {
+        Logger::instance().submit(m_record);
+    }
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    Line& operator<<(std::string_view text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+    Line& operator<<(const char* text) {
+        return *this << std::string_view(text ? text : "(null)");
+    }
+    Line& operator<<(const std::string& text) {
+        return *this << std::string_view(text);
+    }
+    Line& operator<<(char c) {
+        append(&c, 1);
+        return *this;
+    }
+    Line& operator<<(bool value) {
+        return *this << (value ? "true" : "false");
+    }
+    Line& operator<<(double value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                    std::chars_format::general, 6);
+        append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+        return *this;
+    }
+    Line& operator<<(float value) {
+        return *this << static_cast<double>(value);
+    }
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value &&
+                                      !std::is_same<T, bool>::value &&
+                                      !std::is_same<T, char>::value, int>::type = 0>
+    Line& operator<<(T value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+        return *this;
+    }
+
+private:
+    void append(const char* data, std::size_t size) {
+        std::size_t room = kLineCapacity - m_record.length;
+        if (size > room) {
+            size = room;
+            m_truncated = true;
+        }
+        std::memcpy(m_record.text + m_record.length, data, size);
+        m_record.length = static_cast<std::uint16_t>(m_record.length + size);
+        if (m_truncated && kLineCapacity >= 3) {
+            std::memcpy(m_record.text + kLineCapacity - 3, "...", 3);
+        }
+    }
+
+    Record m_record;
+    bool m_truncated = false;
+};
+
+} // namespace logging
+} // namespace airclass
+
+// Logs one line at the given level (Debug, Info, Warn, Error)
+#define AC_LOG(level)                                                                  \
+    if (!::airclass::logging::enabled(::airclass::logging::Level::level)) {}           \
+    else ::airclass::logging::Line(::airclass::logging::Level::level)
+
+// Like AC_LOG but lets through at most `per_second` lines per call site; the
+// next line that passes reports how many were suppressed in between.
+#define AC_LOG_RATE(level, per_second)                                                 \
+    if (!::airclass::logging::enabled(::airclass::logging::Level::level)) {}           \
+    else if (static ::airclass::logging::RateLimiter ac_rate_limiter_(per_second);     \
+             !ac_rate_limiter_.allow()) {}                                             \
+    else ::airclass::logging::Line(::airclass::logging::Level::level,                  \
+                                   ac_rate_limiter_.takeSuppressed())
+
+#endif // AIRCLASS_LOG_HPP
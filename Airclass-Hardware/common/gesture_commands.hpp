@@ -0,0 +1,158 @@
+// Gesture command identifiers shared by the hardware client, the relay server
+// and the desktop application.
+//
+// The numeric value of each CommandType is what goes on the wire in a binary
+// gesture frame (see gesture_frame.hpp), so existing entries must keep their
+// position. New commands are appended just before UNKNOWN.
+
+#ifndef AIRCLASS_GESTURE_COMMANDS_HPP
+#define AIRCLASS_GESTURE_COMMANDS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace airclass {
+
+// Enumeration of gesture/command types sent from the hardware to server
+enum class CommandType : std::uint8_t {
+    ZOOM_IN,
+    ZOOM_RESET,
+    UP,
+    DOWN,
+    RIGHT,
+    LEFT,
+    THREE_GUN,
+    INV_THREE_GUN,
+    TWO_UP,
+    ONE,
+    CALL,
+    LIKE,
+    DISLIKE,
+    ROCK,
+    THREE,
+    THREE2,
+    TIMEOUT,
+    PALM,
+    TAKE_PICTURE,
+    HEART,
+    HEART2,
+    MID_FINGER,
+    THUMB_INDEX,
+    HOLY,
+    UNKNOWN
+};
+
+constexpr std::size_t kCommandCount = static_cast<std::size_t>(CommandType::UNKNOWN);
+
+// JSON command names, indexed by CommandType (must stay in enum order). This
+// table is the one gesture vocabulary of the hardware client, the relay and
+// the desktop; the lookup below is generated from it at compile time.
+constexpr std::string_view kCommandNames[kCommandCount] = {
+    "zoom_in",
+    "zoom_reset",
+    "up",
+    "down",
+    "right",
+    "left",
+    "three_gun",
+    "inv_three_gun",
+    "two_up",
+    "one",
+    "call",
+    "like",
+    "dislike",
+    "rock",
+    "three",
+    "three2",
+    "timeout",
+    "palm",
+    "take_picture",
+    "heart",
+    "heart2",
+    "mid_finger",
+    "thumb_index",
+    "holy",
+};
+
+// Name used in JSON messages; "unknown" for UNKNOWN or out-of-range values.
+// The view refers to a string literal, so data() is also NUL-terminated.
+constexpr std::string_view commandName(CommandType command) {
+    const auto index = static_cast<std::size_t>(command);
+    return index < kCommandCount ? kCommandNames[index] : std::string_view("unknown");
+}
+
+namespace command_detail {
+
+// Perfect hash over kCommandNames: FNV-1a with a seed found at compile time
+// such that every name lands in its own slot of a kSlots-entry table
+constexpr std::size_t kSlots = 64;
+constexpr std::uint8_t kEmptySlot = 0xFF;
+
+constexpr std::uint32_t hashName(std::string_view name, std::uint32_t seed) {
+    std::uint32_t hash = 2166136261u ^ seed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+constexpr bool seedIsPerfect(std::uint32_t seed) {
+    bool used[kSlots] = {};
+    for (std::size_t i = 0; i < kCommandCount; ++i) {
+        const std::size_t slot = hashName(kCommandNames[i], seed) % kSlots;
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr std::uint32_t findSeed() {
+    for (std::uint32_t seed = 0; seed < 100000; ++seed) {
+        if (seedIsPerfect(seed)) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr std::uint32_t kSeed = findSeed();
+static_assert(kSeed != UINT32_MAX, "no perfect hash seed for the command names; raise kSlots");
+
+struct SlotTable {
+    std::uint8_t index[kSlots];
+};
+
+constexpr SlotTable buildSlots() {
+    SlotTable table{};
+    for (std::size_t slot = 0; slot < kSlots; ++slot) table.index[slot] = kEmptySlot;
+    for (std::size_t i = 0; i < kCommandCount; ++i) {
+        table.index[hashName(kCommandNames[i], kSeed) % kSlots] = static_cast<std::uint8_t>(i);
+    }
+    return table;
+}
+
+constexpr SlotTable kSlotTable = buildSlots();
+
+} // namespace command_detail
+
+// Inverse of commandName(): one hash and at most one string compare. Returns
+// UNKNOWN for names that are not commands.
+constexpr CommandType commandFromName(std::string_view name) {
+    using namespace command_detail;
+    const std::uint8_t index = kSlotTable.index[hashName(name, kSeed) % kSlots];
+    if (index == kEmptySlot || kCommandNames[index] != name) return CommandType::UNKNOWN;
+    return static_cast<CommandType>(index);
+}
+
+static_assert(commandFromName("two_up") == CommandType::TWO_UP, "command lookup");
+static_assert(commandFromName("holy") == CommandType::HOLY, "command lookup");
+static_assert(commandFromName("next_slide") == CommandType::UNKNOWN, "command lookup");
+
+// True if a raw command byte from the wire names a known command
+constexpr bool isValidCommand(std::uint8_t value) {
+    return value < kCommandCount;
+}
+
+} // namespace airclass
+
+#endif // AIRCLASS_GESTURE_COMMANDS_HPP
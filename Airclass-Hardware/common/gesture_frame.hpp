@@ -0,0 +1,241 @@
+// Compact binary encoding of a gesture command, sent as a WebSocket binary
+// message instead of the JSON text {"command": ..., "position": {...}}.
+//
+// Layout (all integers little-endian):
+//
+//   offset  size  field
+//        0     1  version      1; 2 with trace fields; 3 with a relay sequence
+//        1     1  command      CommandType value
+//        2     1  flags        kFlagPosition / kFlagDepth / kFlagTrace / kFlagRelaySeq
+//        3     1  reserved     0
+//        4     4  seq          capture sequence number (wraps)
+//        8     8  capture_us   camera frame time in microseconds, CLOCK_MONOTONIC
+//                              of the machine running the recognizer
+//       16     4  x            Q16.16 fixed point
+//       20     4  y            Q16.16 fixed point
+//       24     4  z            Q16.16 fixed point
+//   -- version 2 (kFlagTrace) --
+//       28     4  pipe_us      capture -> hardware client read the pipe
+//       32     4  hw_us        hardware client read -> WebSocket send
+//       36     4  relay_us     relay receive -> fan-out (stamped by the relay)
+//   -- version 3 (kFlagRelaySeq), after the trace fields if present --
+//    28/40     8  relay_seq    relay replay log sequence (see server/replay_log.hpp)
+//
+// Untraced frames are 28 bytes; traced ones are 40; a relay sequence adds 8.
+// The trace durations are measured on a single clock each, so no clock
+// synchronization is needed.
+//
+// Q16.16 covers +-32767 with a resolution of ~0.000015, enough for both the
+// normalized (0..1) and the pixel coordinates the recognizer produces.
+//
+// Binary frames are only used between peers that announced "binary": <version>
+// at registration; everyone else keeps exchanging JSON.
+//
+// Batches: peers that also announced "batch": true may receive several frames
+// in one WebSocket message:
+//
+//        0     1  0 (kBatchMarker; never a valid frame version)
+//        1     1  count
+//   then count times: 1 byte length, followed by that many bytes of frame
+//
+// Decoders that do not know batches reject them as version 0.
+
+#ifndef AIRCLASS_GESTURE_FRAME_HPP
+#define AIRCLASS_GESTURE_FRAME_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "gesture_commands.hpp"
+
+namespace airclass {
+
+constexpr std::uint8_t kFrameVersion = 3;      // Highest version we read and write
+constexpr std::size_t kFrameSize = 28;          // Version 1 / untraced frame
+constexpr std::size_t kTracedFrameSize = 40;    // Version 2 with trace fields
+constexpr std::size_t kMaxFrameSize = kTracedFrameSize + 8;  // Traced, with relay sequence
+constexpr std::size_t kRelayUsOffset = 36;      // Where the relay patches its dwell time
+
+constexpr std::uint8_t kFlagPosition = 0x01;  // x and y are meaningful
+constexpr std::uint8_t kFlagDepth    = 0x02;  // z is meaningful
+constexpr std::uint8_t kFlagTrace    = 0x04;  // pipe_us / hw_us / relay_us follow
+constexpr std::uint8_t kFlagRelaySeq = 0x08;  // relay_seq follows
+
+constexpr std::uint8_t kBatchMarker = 0;           // First byte of a batch message
+constexpr std::size_t kMaxBatchFrames = 255;
+
+struct GestureFrame {
+    CommandType command = CommandType::UNKNOWN;
+    std::uint8_t flags = 0;
+    std::uint32_t seq = 0;
+    std::uint64_t capture_us = 0;
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+    std::uint32_t pipe_us = 0;
+    std::uint32_t hw_us = 0;
+    std::uint32_t relay_us = 0;
+    std::uint64_t relay_seq = 0;
+
+    bool hasPosition() const { return (flags & kFlagPosition) != 0; }
+    bool hasDepth() const { return (flags & kFlagDepth) != 0; }
+    bool hasTrace() const { return (flags & kFlagTrace) != 0; }
+    bool hasRelaySeq() const { return (flags & kFlagRelaySeq) != 0; }
+};
+
+namespace frame_detail {
+
+inline std::int32_t toFixed(double value) {
+    constexpr double kMax = 2147483647.0 / 65536.0;
+    constexpr double kMin = -2147483648.0 / 65536.0;
+    if (!(value == value)) return 0;  // NaN
+    if (value >= kMax) return INT32_MAX;
+    if (value <= kMin) return INT32_MIN;
+    return static_cast<std::int32_t>(std::lround(value * 65536.0));
+}
+
+inline double fromFixed(std::int32_t value) {
+    return static_cast<double>(value) / 65536.0;
+}
+
+inline void put32(unsigned char* out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+inline void put64(unsigned char* out, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+inline std::uint32_t get32(const unsigned char* in) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= static_cast<std::uint32_t>(in[i]) << (8 * i);
+    return value;
+}
+
+inline std::uint64_t get64(const unsigned char* in) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+} // namespace frame_detail
+
+// Writes the frame to out (at least kMaxFrameSize bytes) and returns its
+// length: kFrameSize, plus 12 with kFlagTrace, plus 8 with kFlagRelaySeq
+inline std::size_t encodeFrame(const GestureFrame& frame, void* out) {
+    using namespace frame_detail;
+    auto* p = static_cast<unsigned char*>(out);
+    p[0] = frame.hasRelaySeq() ? 3 : frame.hasTrace() ? 2 : 1;
+    p[1] = static_cast<unsigned char>(frame.command);
+    p[2] = frame.flags;
+    p[3] = 0;
+    put32(p + 4, frame.seq);
+    put64(p + 8, frame.capture_us);
+    put32(p + 16, static_cast<std::uint32_t>(toFixed(frame.x)));
+    put32(p + 20, static_cast<std::uint32_t>(toFixed(frame.y)));
+    put32(p + 24, static_cast<std::uint32_t>(toFixed(frame.z)));
+    std::size_t length = kFrameSize;
+    if (frame.hasTrace()) {
+        put32(p + 28, frame.pipe_us);
+        put32(p + 32, frame.hw_us);
+        put32(p + 36, frame.relay_us);
+        length = kTracedFrameSize;
+    }
+    if (frame.hasRelaySeq()) {
+        put64(p + length, frame.relay_seq);
+        length += 8;
+    }
+    return length;
+}
+
+// Overwrites relay_us in an encoded traced frame (no-op for other frames)
+inline void stampRelayDwell(void* data, std::size_t length, std::uint32_t relay_us) {
+    auto* p = static_cast<unsigned char*>(data);
+    if (length < kTracedFrameSize || p[0] < 2 || (p[2] & kFlagTrace) == 0) return;
+    frame_detail::put32(p + kRelayUsOffset, relay_us);
+}
+
+// Parses a received frame. Returns false for short buffers, version 0 and
+// unknown commands; out is left untouched in that case. Later versions may
+// only append fields, so their frames decode here with the extra bytes ignored.
+inline bool decodeFrame(const void* data, std::size_t length, GestureFrame& out) {
+    using namespace frame_detail;
+    if (data == nullptr || length < kFrameSize) return false;
+    const auto* p = static_cast<const unsigned char*>(data);
+    if (p[0] == 0 || !isValidCommand(p[1])) return false;
+
+    out.command = static_cast<CommandType>(p[1]);
+    out.flags = p[2];
+    out.seq = get32(p + 4);
+    out.capture_us = get64(p + 8);
+    out.x = fromFixed(static_cast<std::int32_t>(get32(p + 16)));
+    out.y = fromFixed(static_cast<std::int32_t>(get32(p + 20)));
+    out.z = fromFixed(static_cast<std::int32_t>(get32(p + 24)));
+    out.pipe_us = out.hw_us = out.relay_us = 0;
+    out.relay_seq = 0;
+    std::size_t offset = kFrameSize;
+    if (p[0] >= 2 && length >= kTracedFrameSize && (out.flags & kFlagTrace) != 0) {
+        out.pipe_us = get32(p + 28);
+        out.hw_us = get32(p + 32);
+        out.relay_us = get32(p + 36);
+        offset = kTracedFrameSize;
+    } else {
+        out.flags &= static_cast<std::uint8_t>(~kFlagTrace);
+    }
+    if (p[0] >= 3 && length >= offset + 8 && (out.flags & kFlagRelaySeq) != 0) {
+        out.relay_seq = get64(p + offset);
+    } else {
+        out.flags &= static_cast<std::uint8_t>(~kFlagRelaySeq);
+    }
+    return true;
+}
+
+// True if a binary message is a batch rather than a single frame
+inline bool isBatch(const void* data, std::size_t length) {
+    return data != nullptr && length >= 2 && static_cast<const unsigned char*>(data)[0] == kBatchMarker;
+}
+
+// Starts an empty batch in out (a std::string or similar byte container)
+template <typename Buffer>
+inline void beginBatch(Buffer& out) {
+    out.clear();
+    out.push_back(static_cast<char>(kBatchMarker));
+    out.push_back(0);
+}
+
+// Appends one encoded frame. Returns false (leaving out unchanged) when the
+// batch is full or the frame is not a plausible gesture frame.
+template <typename Buffer>
+inline bool appendToBatch(Buffer& out, const void* frame, std::size_t length) {
+    const auto count = static_cast<unsigned char>(out[1]);
+    if (count >= kMaxBatchFrames || length < kFrameSize || length > 255) return false;
+    const auto* bytes = static_cast<const char*>(frame);
+    out.push_back(static_cast<char>(length));
+    out.insert(out.end(), bytes, bytes + length);
+    out[1] = static_cast<char>(count + 1);
+    return true;
+}
+
+// Calls fn(const unsigned char* frame, std::size_t length) for each frame of a
+// batch. Returns false for a malformed batch; frames before the damage have
+// been passed to fn by then.
+template <typename Fn>
+inline bool forEachInBatch(const void* data, std::size_t length, Fn&& fn) {
+    if (!isBatch(data, length)) return false;
+    const auto* p = static_cast<const unsigned char*>(data);
+    const std::size_t count = p[1];
+    std::size_t offset = 2;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (offset >= length) return false;
+        const std::size_t frame_length = p[offset++];
+        if (frame_length > length - offset) return false;
+        fn(p + offset, frame_length);
+        offset += frame_length;
+    }
+    return offset == length;
+}
+
+} // namespace airclass
+
+#endif // AIRCLASS_GESTURE_FRAME_HPP
@@ -0,0 +1,113 @@
+// Lock-free log-linear histogram (HDR-style) for latencies and queue depths.
+//
+// Values are unsigned integers (microseconds for latencies, message counts for
+// depths). Every power-of-two range is split into kSubBuckets linear buckets,
+// so any recorded value lands in a bucket at most 1/kSubBuckets (6.25%) wider
+// than the value itself, from 1 up to 2^kMaxExponent. Larger values are
+// clamped into the last bucket.
+//
+// record() is a couple of relaxed atomic increments and may be called from any
+// thread. Readers see an approximately consistent view, which is all a metrics
+// scrape needs.
+
+#ifndef AIRCLASS_LATENCY_HISTOGRAM_HPP
+#define AIRCLASS_LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace airclass {
+namespace metrics {
+
+class LogLinearHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr std::uint64_t kSubBuckets = 1u << kSubBucketBits;  // Per power of two
+    static constexpr unsigned kMaxExponent = 40;                         // ~12.7 days in us
+    static constexpr std::size_t kBucketCount = kSubBuckets * (kMaxExponent - kSubBucketBits + 2);
+    static constexpr std::uint64_t kMaxValue = (std::uint64_t{1} << (kMaxExponent + 1)) - 1;
+
+    void record(std::uint64_t value) {
+        if (value > kMaxValue) value = kMaxValue;
+        m_buckets[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        std::uint64_t seen = m_max.load(std::memory_order_relaxed);
+        while (value > seen && !m_max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    std::uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // Number of recorded values strictly below bound. Exact when bound is a
+    // bucket boundary (every power of two is one), otherwise rounded down to
+    // the nearest boundary.
+    std::uint64_t countBelow(std::uint64_t bound) const {
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            if (upperBound(i) > bound) break;
+            total += m_buckets[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Value at quantile q (0..1), reported as the midpoint of its bucket
+    std::uint64_t quantile(double q) const {
+        const std::uint64_t total = count();
+        if (total == 0) return 0;
+        if (q < 0.0) q = 0.0;
+        if (q > 1.0) q = 1.0;
+        std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                const std::uint64_t mid = lowerBound(i) + (upperBound(i) - lowerBound(i)) / 2;
+                return mid < max() ? mid : max();
+            }
+        }
+        return max();
+    }
+
+    // Bucket of a value: identity below 2 * kSubBuckets, then kSubBuckets
+    // linear steps per power of two
+    static std::size_t indexOf(std::uint64_t value) {
+        if (value < 2 * kSubBuckets) return static_cast<std::size_t>(value);
+        const unsigned shift = msb(value) - kSubBucketBits;
+        return static_cast<std::size_t>(kSubBuckets * shift + (value >> shift));
+    }
+
+    static std::uint64_t lowerBound(std::size_t index) {
+        if (index < 2 * kSubBuckets) return index;
+        const unsigned shift = static_cast<unsigned>(index / kSubBuckets) - 1;
+        return (index - kSubBuckets * shift) << shift;
+    }
+
+    // Exclusive upper bound of a bucket
+    static std::uint64_t upperBound(std::size_t index) {
+        if (index < 2 * kSubBuckets) return index + 1;
+        const unsigned shift = static_cast<unsigned>(index / kSubBuckets) - 1;
+        return (index - kSubBuckets * shift + 1) << shift;
+    }
+
+private:
+    static unsigned msb(std::uint64_t value) {
+        unsigned bit = 0;
+        while (value >>= 1) ++bit;
+        return bit;
+    }
+
+    std::array<std::atomic<std::uint64_t>, kBucketCount> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_sum{0};
+    std::atomic<std::uint64_t> m_max{0};
+};
+
+} // namespace metrics
+} // namespace airclass
+
+#endif // AIRCLASS_LATENCY_HISTOGRAM_HPP
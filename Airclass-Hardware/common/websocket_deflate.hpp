@@ -0,0 +1,49 @@
+// Optional permessage-deflate (RFC 7692) for the WebSocket++ endpoints.
+//
+// Built with -DAIRCLASS_DEFLATE (CMake option of the same name, needs zlib),
+// WithDeflate<Config> is Config with WebSocket++'s deflate extension enabled;
+// otherwise it is Config itself and no zlib is linked. The extension is only
+// used on connections whose peer offers it during the handshake, and only for
+// messages marked with set_compressed(true): the relay marks messages of at
+// least AIRCLASS_DEFLATE_MIN_BYTES, since gesture frames are too small to gain
+// anything from compression.
+
+#ifndef AIRCLASS_WEBSOCKET_DEFLATE_HPP
+#define AIRCLASS_WEBSOCKET_DEFLATE_HPP
+
+#include <cstddef>
+
+#ifdef AIRCLASS_DEFLATE
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#endif
+
+namespace airclass {
+
+#ifdef AIRCLASS_DEFLATE
+
+template <typename Config>
+struct WithDeflate : Config {
+    typedef WithDeflate type;
+
+    struct permessage_deflate_config {};
+    typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config>
+        permessage_deflate_type;
+};
+
+constexpr bool kDeflateAvailable = true;
+
+#else
+
+template <typename Config>
+using WithDeflate = Config;
+
+constexpr bool kDeflateAvailable = false;
+
+#endif
+
+// Messages smaller than this are sent uncompressed by default
+constexpr std::size_t kDefaultDeflateMinBytes = 256;
+
+} // namespace airclass
+
+#endif // AIRCLASS_WEBSOCKET_DEFLATE_HPP
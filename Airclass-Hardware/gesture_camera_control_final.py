@@ -69,6 +69,19 @@ ZOOM_CONFIG = {
 PIPE_PATH = "/tmp/gesture_pipe"
 pipe_fd = None
 
+# AIRCLASS_TRANSPORT=shm: use the shared-memory ring instead of the pipe
+# (hardware_client must be started with the same setting)
+gesture_ring = None
+if os.environ.get("AIRCLASS_TRANSPORT") == "shm":
+    from gesture_ring import GestureRing
+    gesture_ring = GestureRing()
+    print("Sending gestures through the shared-memory ring")
+
+# Latency tracing: every command carries the monotonic time (CLOCK_MONOTONIC,
+# microseconds) of the camera frame it was recognised in, plus a sequence id
+frame_capture_us = 0
+message_seq = 0
+
 # --- Picamera2 Initialization ---
 picam2 = Picamera2()
 config = picam2.create_preview_configuration(main={"size": (FRAME_WIDTH, FRAME_HEIGHT), "format": "RGB888"})
@@ -177,16 +190,24 @@ def set_servo_angle_pca9685(servo_channel, angle, current_angle_ref, min_angle_l
 
 def send_websocket(command, position_data=None):
     """Send command to the C++ program via the named pipe"""
-    global pipe_fd
+    global pipe_fd, message_seq
     
+    message_seq = (message_seq + 1) & 0xFFFFFFFF
     message = {
         "command": command,
+        "seq": message_seq,
+        "capture_us": frame_capture_us,
     }
     
     if position_data:
         message["position"] = position_data
     
     json_str = json.dumps(message) + "\n"
+
+    if gesture_ring is not None:
+        if gesture_ring.push(json_str) and DEBUG:
+            print(f"Sent: {command}")
+        return
     
     try:
         if pipe_fd is None:
@@ -454,6 +475,7 @@ print("Press 'q' to quit")
 try:
     while True:
         frame_raw = picam2.capture_array()
+        frame_capture_us = time.monotonic_ns() // 1000
         frame = cv2.flip(frame_raw, 1)  # Flip for gesture recognition
         image_rgb = frame_raw  # Use original for face detection
         
@@ -0,0 +1,92 @@
+"""Producer side of the shared-memory gesture ring (hardware_server/gesture_ring.hpp).
+
+hardware_client creates the ring when started with AIRCLASS_TRANSPORT=shm;
+this module attaches to it through libairclass_gesture_ring.so (built next to
+hardware_client) and appends one JSON message per gesture. Unlike the
+non-blocking FIFO, a full ring makes push() wait for the consumer instead of
+dropping the message, but only while hardware_client is running: with the
+consumer gone, push() fails at once and the camera loop keeps its frame rate.
+
+    ring = GestureRing()
+    ring.push(json.dumps(message))   # False only if hardware_client is gone
+"""
+
+import ctypes
+import ctypes.util
+import errno
+import os
+
+DEFAULT_NAME = "/airclass_gestures"
+DEFAULT_TIMEOUT_US = 50000  # Longest a push may wait for room
+
+
+def _load_library():
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [
+        os.environ.get("AIRCLASS_RING_LIB"),
+        os.path.join(here, "hardware_server", "build", "libairclass_gesture_ring.so"),
+        os.path.join(here, "libairclass_gesture_ring.so"),
+        ctypes.util.find_library("airclass_gesture_ring"),
+    ]
+    for path in candidates:
+        if path and (os.path.exists(path) or not os.path.isabs(path)):
+            try:
+                lib = ctypes.CDLL(path, use_errno=True)
+                break
+            except OSError:
+                continue
+    else:
+        raise OSError("libairclass_gesture_ring.so not found; build hardware_server or set AIRCLASS_RING_LIB")
+
+    lib.airclass_ring_attach.argtypes = [ctypes.c_char_p]
+    lib.airclass_ring_attach.restype = ctypes.c_void_p
+    lib.airclass_ring_push.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_ulong, ctypes.c_longlong]
+    lib.airclass_ring_push.restype = ctypes.c_int
+    lib.airclass_ring_close.argtypes = [ctypes.c_void_p]
+    lib.airclass_ring_close.restype = None
+    return lib
+
+
+class GestureRing:
+    """Appends messages to the ring, attaching lazily (hardware_client may start later)."""
+
+    def __init__(self, name=None, timeout_us=DEFAULT_TIMEOUT_US):
+        self._lib = _load_library()
+        self._name = (name or os.environ.get("AIRCLASS_SHM_NAME") or DEFAULT_NAME).encode()
+        self._timeout_us = timeout_us
+        self._handle = None
+        self.failed = 0  # Messages that could not be delivered
+
+    def _attach(self):
+        if self._handle is None:
+            handle = self._lib.airclass_ring_attach(self._name)
+            if handle:
+                self._handle = handle
+        return self._handle is not None
+
+    def push(self, message):
+        """Appends one message (str or bytes). Returns False if it was not delivered."""
+        if isinstance(message, str):
+            message = message.encode("utf-8")
+        if not self._attach():
+            self.failed += 1
+            return False
+        result = self._lib.airclass_ring_push(self._handle, message, len(message), self._timeout_us)
+        if result != 0:
+            self.failed += 1
+            if result == errno.EPIPE:
+                print("Gesture ring full and hardware_client is not running; message dropped")
+            elif result == errno.ETIMEDOUT:
+                print("Gesture ring full for %d us; is hardware_client running?" % self._timeout_us)
+            else:
+                print("Gesture ring push failed: %s" % os.strerror(result))
+            return False
+        return True
+
+    def close(self):
+        if self._handle is not None:
+            self._lib.airclass_ring_close(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
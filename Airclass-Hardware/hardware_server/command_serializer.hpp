@@ -0,0 +1,122 @@
+// Fast JSON rendering of gesture commands for relays that did not accept
+// binary frames.
+//
+// The message shape is fixed:
+//
+//   {"command":"<name>","position":{"x":..,"y":..[,"z":..]},
+//    "seq":..,"capture_us":..,"trace":{"pipe_us":..,"hw_us":..}}
+//
+// with position, seq/capture_us and the trace object optional. The {"command":"<name>"
+// prefix of every CommandType is rendered once; numbers are written with
+// std::to_chars (shortest round-trip form, like nlohmann::json). Output goes
+// into a caller-provided buffer, so rendering allocates nothing.
+// WebSocketHardwareClient falls back to nlohmann::json for positions that
+// are not plain {x, y[, z]} numbers.
+
+#ifndef AIRCLASS_COMMAND_SERIALIZER_HPP
+#define AIRCLASS_COMMAND_SERIALIZER_HPP
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "gesture_commands.hpp"
+
+namespace airclass {
+
+class CommandSerializer {
+public:
+    // Largest message render() writes: prefix plus every optional field
+    static constexpr std::size_t kMaxMessage = 320;
+
+    struct Position {
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+        bool has_z = false;
+    };
+
+    struct Trace {
+        std::uint32_t seq = 0;
+        std::uint64_t capture_us = 0;
+        std::uint32_t pipe_us = 0;
+        std::uint32_t hw_us = 0;
+        bool has_hops = true;  // Write the "trace" object, not just seq and capture_us
+    };
+
+    CommandSerializer() {
+        for (std::size_t i = 0; i < kCommandCount; ++i) {
+            m_prefixes[i] = "{\"command\":\"";
+            m_prefixes[i] += kCommandNames[i];
+            m_prefixes[i] += '"';
+        }
+    }
+
+    // Process-wide instance; the prefixes never change after construction
+    static const CommandSerializer& instance() {
+        static const CommandSerializer serializer;
+        return serializer;
+    }
+
+    // Writes the message for command into out (kMaxMessage bytes) and returns
+    // a view of it. position and trace may be null. command must be valid.
+    std::string_view render(CommandType command, const Position* position, const Trace* trace,
+                            char (&out)[kMaxMessage]) const {
+        const std::string& prefix = m_prefixes[static_cast<std::size_t>(command)];
+        char* p = out;
+        std::memcpy(p, prefix.data(), prefix.size());
+        p += prefix.size();
+        char* const end = out + kMaxMessage;
+
+        if (position != nullptr) {
+            p = literal(p, ",\"position\":{\"x\":");
+            p = number(p, end, position->x);
+            p = literal(p, ",\"y\":");
+            p = number(p, end, position->y);
+            if (position->has_z) {
+                p = literal(p, ",\"z\":");
+                p = number(p, end, position->z);
+            }
+            *p++ = '}';
+        }
+        if (trace != nullptr) {
+            p = literal(p, ",\"seq\":");
+            p = std::to_chars(p, end, trace->seq).ptr;
+            p = literal(p, ",\"capture_us\":");
+            p = std::to_chars(p, end, trace->capture_us).ptr;
+            if (trace->has_hops) {
+                p = literal(p, ",\"trace\":{\"pipe_us\":");
+                p = std::to_chars(p, end, trace->pipe_us).ptr;
+                p = literal(p, ",\"hw_us\":");
+                p = std::to_chars(p, end, trace->hw_us).ptr;
+                *p++ = '}';
+            }
+        }
+        *p++ = '}';
+        return std::string_view(out, static_cast<std::size_t>(p - out));
+    }
+
+private:
+    template <std::size_t N>
+    static char* literal(char* p, const char (&text)[N]) {
+        std::memcpy(p, text, N - 1);
+        return p + N - 1;
+    }
+
+    // JSON has no NaN or infinity; nlohmann::json writes null for them too
+    static char* number(char* p, char* end, double value) {
+        if (!std::isfinite(value)) return literal(p, "null");
+        return std::to_chars(p, end, value).ptr;
+    }
+
+    std::array<std::string, kCommandCount> m_prefixes;
+};
+
+} // namespace airclass
+
+#endif // AIRCLASS_COMMAND_SERIALIZER_HPP
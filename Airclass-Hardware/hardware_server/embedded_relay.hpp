@@ -0,0 +1,90 @@
+// Runs the relay inside the hardware client (AIRCLASS_EMBEDDED_RELAY).
+//
+// The Pi normally runs the relay as its own process and the hardware client
+// connects to it over ws://localhost, so every gesture is serialized, sent
+// through the loopback socket and decoded again before the fan-out. Here the
+// AirClassServer accept loop runs on background threads of this process and
+// gestures go to its fan-out as frames in memory. Desktops still connect
+// (and discover the relay) over the network exactly as before.
+//
+// Offers the same calls as RelayPublisher, so GestureControlSystem can use
+// either.
+
+#ifndef AIRCLASS_EMBEDDED_RELAY_HPP
+#define AIRCLASS_EMBEDDED_RELAY_HPP
+
+#include <algorithm>                               // std::max
+#include <cstdint>                                 // std::uint16_t, std::uint32_t
+#include <string>                                  // std::string
+#include <thread>                                  // std::thread::hardware_concurrency
+
+// WebSocketHardwareClient::toFrame, CommandTrace, steadyNowUs
+#include "websocket_hardware_client.hpp"
+// The relay itself (server/airclass_server.hpp)
+#include "airclass_server.hpp"
+
+class EmbeddedRelay {
+public:
+    EmbeddedRelay(std::uint16_t port, std::size_t threads, const std::string& clientId,
+                  const std::string& room, bool tracing)
+        : m_port(port)
+        , m_threads(threads)
+        , m_tracing(tracing)
+        , m_producer(m_server.register_local(clientId, room))
+    {}
+
+    ~EmbeddedRelay() {
+        stop();
+    }
+
+    // Starts accepting desktops. Unlike a remote relay, a port that cannot
+    // be opened is not retried.
+    bool connect() {
+        m_running = m_server.start(m_port, m_threads);
+        return m_running;
+    }
+
+    void stop() {
+        if (!m_running) return;
+        m_running = false;
+        m_server.stop();
+    }
+
+    // Hands one command to the relay's fan-out. The relay thins positions to
+    // AIRCLASS_POSITION_HZ and queues commands for reconnecting desktops, as
+    // for a hardware connection. Not thread-safe: call from one thread.
+    bool send(CommandType cmd_type, const json& position_data, const CommandTrace& trace) {
+        if (!m_running || cmd_type == CommandType::UNKNOWN) return false;
+        CommandTrace stamped = trace;
+        if (!stamped.has_seq) {
+            stamped.has_seq = true;
+            stamped.seq = m_nextSeq++;
+        }
+        if (stamped.capture_us == 0) {
+            stamped.capture_us = steadyNowUs();
+        }
+        const bool traced = m_tracing && stamped.read_us != 0;
+        m_server.publish_local(m_producer, WebSocketHardwareClient::toFrame(
+            cmd_type, position_data, stamped, traced, steadyNowUs()));
+        return true;
+    }
+
+    bool anyConnected() const { return m_running; }
+
+private:
+    AirClassServer      m_server;           // Relay, on its own worker threads once started
+    const std::uint16_t m_port;             // Port desktops connect to
+    const std::size_t   m_threads;          // Relay worker threads
+    const bool          m_tracing;          // Attach per-hop latency to commands
+    const ClientInfo    m_producer;         // This process as the room's hardware client
+    bool                m_running = false;  // Between connect() and stop()
+    std::uint32_t       m_nextSeq = 0;      // Seq of the next command without one
+};
+
+// Relay worker threads for the embedded relay: AIRCLASS_THREADS, else one
+// per core
+inline std::size_t embeddedRelayThreads() {
+    return envSize("AIRCLASS_THREADS", std::max(1u, std::thread::hardware_concurrency()));
+}
+
+#endif // AIRCLASS_EMBEDDED_RELAY_HPP
@@ -0,0 +1,367 @@
+// Single-producer / single-consumer message ring in POSIX shared memory, an
+// alternative to the named pipe between the Python recognizer (producer) and
+// hardware_client (consumer).
+//
+// Layout of the shared object (shm_open name, e.g. "/airclass_gestures"):
+//
+//   Header   magic, version, capacity, then head / tail / doorbells, each on
+//            its own cache line
+//   data     capacity bytes (a power of two) of records:
+//              u32 length, payload, padding to 8 bytes
+//            A record never wraps: when it does not fit before the end, the
+//            producer writes a kWrapMarker length there and starts at 0.
+//
+// head and tail count bytes ever written / consumed, so head - tail is the fill
+// level and neither ever wraps. The producer only stores head and the consumer
+// only stores tail; each reads the other's with acquire ordering, so no lock
+// is needed.
+//
+// Waiting uses futexes on shared words rather than polling:
+//   - data_bell: bumped by the producer after publishing; the consumer sleeps
+//     on it when the ring is empty (after a short spin, for sub-microsecond
+//     handoff when messages are flowing)
+//   - space_bell: bumped by the consumer after freeing space; a producer facing
+//     a full ring sleeps on it instead of dropping the message
+// Wakeups are only issued when the other side announced it is sleeping.
+//
+// The consumer publishes its PID in the header while it has the ring open. A
+// producer facing a full ring whose consumer is gone fails at once (EPIPE)
+// rather than stalling its caller for the whole timeout on every message.
+//
+// The consumer creates the object and keeps it across restarts, so a producer
+// stays attached to the same ring. Messages written while hardware_client was
+// down are discarded when it reopens the ring: replaying a backlog of stale
+// gestures would change slides long after they were made.
+
+#ifndef AIRCLASS_GESTURE_RING_HPP
+#define AIRCLASS_GESTURE_RING_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace airclass {
+
+class GestureRing {
+public:
+    static constexpr std::size_t kDefaultCapacity = 64 * 1024;
+    static constexpr std::size_t kMaxMessage = 4096;
+
+    GestureRing() = default;
+    GestureRing(const GestureRing&) = delete;
+    GestureRing& operator=(const GestureRing&) = delete;
+
+    ~GestureRing() {
+        close();
+    }
+
+    // Consumer side: maps name, creating or re-initializing it when it does
+    // not hold a ring of this capacity. Returns false (errno set) on failure.
+    bool create(const std::string& name, std::size_t capacity = kDefaultCapacity) {
+        close();
+        if (capacity < 2 * recordSize(kMaxMessage) || (capacity & (capacity - 1)) != 0) {
+            errno = EINVAL;
+            return false;
+        }
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) return false;
+        const std::size_t size = sizeof(Header) + capacity;
+        struct stat info;
+        const bool fresh = fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) != size;
+        if (fresh && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (!map(fd, size)) return false;
+
+        if (fresh || m_header->magic != kMagic || m_header->version != kVersion ||
+            m_header->capacity != capacity) {
+            std::memset(static_cast<void*>(m_header), 0, sizeof(Header));
+            m_header->version = kVersion;
+            m_header->capacity = static_cast<std::uint32_t>(capacity);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_header->magic = kMagic;  // Last, so a producer never sees a half-built header
+        } else {
+            // Skip what was written while no consumer ran, and release a
+            // producer waiting for that space
+            m_header->tail.store(m_header->head.load(std::memory_order_acquire), std::memory_order_seq_cst);
+            m_header->space_bell.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(&m_header->space_bell);
+        }
+        m_capacity = capacity;
+        m_consumer = true;
+        m_header->consumer_pid.store(static_cast<std::uint32_t>(getpid()), std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Producer side: maps an existing ring. Fails with ENOENT until the
+    // consumer created it, and with EPROTO for an incompatible object.
+    bool attach(const std::string& name) {
+        close();
+        const int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            errno = EPROTO;
+            return false;
+        }
+        if (!map(fd, static_cast<std::size_t>(info.st_size))) return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->magic != kMagic || m_header->version != kVersion ||
+            sizeof(Header) + m_header->capacity != m_size) {
+            close();
+            errno = EPROTO;
+            return false;
+        }
+        m_capacity = m_header->capacity;
+        return true;
+    }
+
+    void close() {
+        if (m_base != nullptr && m_consumer) {
+            // Gone: producers stop waiting for us, including one asleep right now
+            m_header->consumer_pid.store(0, std::memory_order_seq_cst);
+            m_header->space_bell.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(&m_header->space_bell);
+        }
+        if (m_base != nullptr) {
+            munmap(m_base, m_size);
+        }
+        m_consumer = false;
+        m_base = nullptr;
+        m_header = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+        m_capacity = 0;
+    }
+
+    bool isOpen() const { return m_base != nullptr; }
+
+    // Producer: appends one message. Waits up to timeout_us for the consumer
+    // to make room when the ring is full. Returns false if the message is too
+    // large (EMSGSIZE), the ring is full and no consumer is running (EPIPE),
+    // or the ring stayed full (ETIMEDOUT).
+    bool push(const void* data, std::size_t length, std::int64_t timeout_us) {
+        if (!isOpen() || length > kMaxMessage) {
+            errno = EMSGSIZE;
+            return false;
+        }
+        const std::size_t record = recordSize(length);
+        const std::uint64_t head = m_header->head.load(std::memory_order_relaxed);
+        const std::size_t offset = head & (m_capacity - 1);
+        const std::size_t skip = offset + record > m_capacity ? m_capacity - offset : 0;
+        if (!waitForSpace(head, skip + record, timeout_us)) return false;
+
+        std::uint64_t next = head;
+        if (skip != 0) {
+            storeLength(offset, kWrapMarker);
+            next += skip;
+        }
+        const std::size_t at = next & (m_capacity - 1);
+        storeLength(at, static_cast<std::uint32_t>(length));
+        std::memcpy(m_data + at + sizeof(std::uint32_t), data, length);
+        m_header->head.store(next + record, std::memory_order_seq_cst);
+
+        // Ring the doorbell only if the consumer is (about to be) asleep
+        m_header->data_bell.fetch_add(1, std::memory_order_seq_cst);
+        if (m_header->consumer_waiting.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&m_header->data_bell);
+        }
+        return true;
+    }
+
+    // Consumer: calls fn(std::string_view message) for every message available
+    // now, oldest first, with views into the ring itself (valid during the
+    // call). Returns the number of messages consumed.
+    template <typename Fn>
+    std::size_t consume(Fn&& fn) {
+        if (!isOpen()) return 0;
+        std::uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = m_header->head.load(std::memory_order_acquire);
+        std::size_t count = 0;
+        while (tail != head) {
+            const std::size_t offset = tail & (m_capacity - 1);
+            const std::uint32_t length = loadLength(offset);
+            if (length == kWrapMarker) {
+                tail += m_capacity - offset;
+                continue;
+            }
+            if (length > kMaxMessage) {
+                // Corrupt record (e.g. a producer died mid-write of an older
+                // layout): drop everything published so far and resynchronize
+                tail = head;
+                break;
+            }
+            fn(std::string_view(reinterpret_cast<const char*>(m_data + offset + sizeof(std::uint32_t)), length));
+            tail += recordSize(length);
+            count++;
+        }
+        m_header->tail.store(tail, std::memory_order_seq_cst);
+        if (m_header->producer_waiting.load(std::memory_order_seq_cst) != 0) {
+            m_header->space_bell.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(&m_header->space_bell);
+        }
+        return count;
+    }
+
+    // Consumer: returns when messages are available, after timeout_ms (-1 =
+    // no limit), or once running is false (set it, then call wake()). Spins
+    // briefly before sleeping.
+    bool wait(int timeout_ms, const std::atomic<bool>& running) {
+        if (!isOpen()) return false;
+        for (int spin = 0; spin < kSpinIterations; ++spin) {
+            if (available() || !running.load(std::memory_order_relaxed)) return available();
+            cpuRelax();
+        }
+        // Checked after taking the doorbell value: a wake() from here on
+        // changes it and the futex does not sleep
+        const std::uint32_t bell = m_header->data_bell.load(std::memory_order_seq_cst);
+        m_header->consumer_waiting.store(1, std::memory_order_seq_cst);
+        if (!available() && running.load(std::memory_order_seq_cst)) {
+            futexWait(&m_header->data_bell, bell, timeout_ms < 0 ? -1 : std::int64_t{timeout_ms} * 1000);
+        }
+        m_header->consumer_waiting.store(0, std::memory_order_relaxed);
+        return available();
+    }
+
+    // Wakes a consumer blocked in wait(), for shutdown
+    void wake() {
+        if (!isOpen()) return;
+        m_header->data_bell.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(&m_header->data_bell);
+    }
+
+    bool available() const {
+        return m_header->head.load(std::memory_order_acquire) != m_header->tail.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr std::uint32_t kMagic = 0x474E5241;  // "ARNG"
+    static constexpr std::uint32_t kVersion = 2;
+    static constexpr std::uint32_t kWrapMarker = 0xFFFFFFFF;
+    static constexpr int kSpinIterations = 2000;         // A few microseconds on a Pi
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ring counters must be lock-free");
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "ring doorbells must be lock-free");
+
+    struct Header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t capacity;
+        std::atomic<std::uint32_t> consumer_pid;                 // 0 while no consumer has it open
+        alignas(64) std::atomic<std::uint64_t> head;              // Written by the producer
+        alignas(64) std::atomic<std::uint64_t> tail;              // Written by the consumer
+        alignas(64) std::atomic<std::uint32_t> data_bell;         // Producer -> consumer futex
+        std::atomic<std::uint32_t> consumer_waiting;
+        alignas(64) std::atomic<std::uint32_t> space_bell;        // Consumer -> producer futex
+        std::atomic<std::uint32_t> producer_waiting;
+    };
+
+    static std::size_t recordSize(std::size_t length) {
+        return (sizeof(std::uint32_t) + length + 7) & ~std::size_t{7};
+    }
+
+    bool map(int fd, std::size_t size) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+        m_base = static_cast<unsigned char*>(mapping);
+        m_size = size;
+        m_header = reinterpret_cast<Header*>(m_base);
+        m_data = m_base + sizeof(Header);
+        return true;
+    }
+
+    void storeLength(std::size_t offset, std::uint32_t length) {
+        std::memcpy(m_data + offset, &length, sizeof(length));
+    }
+
+    std::uint32_t loadLength(std::size_t offset) const {
+        std::uint32_t length;
+        std::memcpy(&length, m_data + offset, sizeof(length));
+        return length;
+    }
+
+    // Whether the process that created the ring still runs. EPERM means it
+    // exists under another user.
+    bool consumerAlive() const {
+        const std::uint32_t pid = m_header->consumer_pid.load(std::memory_order_seq_cst);
+        return pid != 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+    }
+
+    // Producer: waits until needed bytes past head are free. Fails with
+    // ETIMEDOUT, or EPIPE as soon as the consumer is found gone.
+    bool waitForSpace(std::uint64_t head, std::size_t needed, std::int64_t timeout_us) {
+        const auto fits = [&]() {
+            return head + needed - m_header->tail.load(std::memory_order_acquire) <= m_capacity;
+        };
+        if (fits()) return true;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+        while (true) {
+            const std::uint32_t bell = m_header->space_bell.load(std::memory_order_seq_cst);
+            m_header->producer_waiting.store(1, std::memory_order_seq_cst);
+            if (fits()) break;
+            const bool alive = consumerAlive();
+            const auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (!alive || left <= 0) {
+                m_header->producer_waiting.store(0, std::memory_order_relaxed);
+                errno = alive ? ETIMEDOUT : EPIPE;
+                return false;
+            }
+            futexWait(&m_header->space_bell, bell, left);
+        }
+        m_header->producer_waiting.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Shared (not FUTEX_PRIVATE) futexes: the two sides are different processes
+    static void futexWait(std::atomic<std::uint32_t>* word, std::uint32_t expected, std::int64_t timeout_us) {
+        struct timespec timeout;
+        struct timespec* timeout_ptr = nullptr;
+        if (timeout_us >= 0) {
+            timeout.tv_sec = static_cast<time_t>(timeout_us / 1000000);
+            timeout.tv_nsec = static_cast<long>(timeout_us % 1000000) * 1000;
+            timeout_ptr = &timeout;
+        }
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, timeout_ptr, nullptr, 0);
+    }
+
+    static void futexWake(std::atomic<std::uint32_t>* word) {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    static void cpuRelax() {
+#if defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    unsigned char* m_base = nullptr;
+    std::size_t m_size = 0;
+    Header* m_header = nullptr;
+    unsigned char* m_data = nullptr;
+    std::size_t m_capacity = 0;
+    bool m_consumer = false;  // Opened with create(); owns consumer_pid
+};
+
+} // namespace airclass
+
+#endif // AIRCLASS_GESTURE_RING_HPP
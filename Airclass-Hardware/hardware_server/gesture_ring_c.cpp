@@ -0,0 +1,35 @@
+// C interface to the producer side of GestureRing, for the Python recognizer
+// (loaded with ctypes by gesture_ring.py). Built as libairclass_gesture_ring.
+
+#include <new>
+
+#include "gesture_ring.hpp"
+
+extern "C" {
+
+// Attaches to the ring hardware_client created. Returns nullptr (errno set)
+// when it does not exist yet or is incompatible.
+void* airclass_ring_attach(const char* name) {
+    auto* ring = new (std::nothrow) airclass::GestureRing();
+    if (ring == nullptr) return nullptr;
+    if (!ring->attach(name)) {
+        const int saved = errno;
+        delete ring;
+        errno = saved;
+        return nullptr;
+    }
+    return ring;
+}
+
+// Appends one message, waiting up to timeout_us for room. Returns 0 on
+// success, otherwise an errno value (EMSGSIZE, EPIPE, ETIMEDOUT).
+int airclass_ring_push(void* ring, const void* data, unsigned long length, long long timeout_us) {
+    if (ring == nullptr) return EINVAL;
+    return static_cast<airclass::GestureRing*>(ring)->push(data, length, timeout_us) ? 0 : errno;
+}
+
+void airclass_ring_close(void* ring) {
+    delete static_cast<airclass::GestureRing*>(ring);
+}
+
+} // extern "C"
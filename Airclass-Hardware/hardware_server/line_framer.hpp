@@ -0,0 +1,86 @@
+// Newline framing over a fixed buffer, for the gesture pipe.
+//
+// Bytes are read straight into the free space at the end of the buffer
+// (writable()/commit()), and every complete line is handed out as a
+// std::string_view into the buffer itself. Only the unterminated tail of a
+// read is moved, once per read, to the front. Nothing is allocated after
+// construction and each byte is scanned once, however many lines one read
+// holds.
+//
+// A wrapping ring buffer cannot hand a line that wraps around as one
+// contiguous view, so the buffer is compacted instead; the moved tail is
+// shorter than one line.
+//
+// A line longer than the buffer cannot be framed; it is skipped up to its
+// newline and counted in oversized().
+
+#ifndef AIRCLASS_LINE_FRAMER_HPP
+#define AIRCLASS_LINE_FRAMER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+class LineFramer {
+public:
+    explicit LineFramer(std::size_t capacity = 64 * 1024)
+        : m_buffer(new char[capacity])
+        , m_capacity(capacity)
+    {}
+
+    // Free space to read into; never empty
+    char* writable() { return m_buffer.get() + m_size; }
+    std::size_t writableSize() const { return m_capacity - m_size; }
+
+    // Makes the bytes just read into writable() part of the buffer and calls
+    // fn(std::string_view line) for every complete, non-empty line (without
+    // its newline). The views are valid only during the call.
+    template <typename Fn>
+    void commit(std::size_t length, Fn&& fn) {
+        const char* data = m_buffer.get();
+        std::size_t start = 0;
+        std::size_t scan = m_size;       // Bytes before this were already searched
+        m_size += length;
+        while (const void* found = std::memchr(data + scan, '\n', m_size - scan)) {
+            const std::size_t end = static_cast<const char*>(found) - data;
+            if (m_skipping) {
+                m_skipping = false;       // End of an oversized line
+            } else if (end > start) {
+                fn(std::string_view(data + start, end - start));
+            }
+            start = scan = end + 1;
+        }
+
+        const std::size_t tail = m_size - start;
+        if (tail == m_capacity) {
+            // No newline in a full buffer: drop what we have and skip to the next one
+            if (!m_skipping) m_oversized++;
+            m_skipping = true;
+            m_size = 0;
+        } else if (start > 0) {
+            std::memmove(m_buffer.get(), data + start, tail);
+            m_size = tail;
+        }
+    }
+
+    // Drops a partial line, e.g. when its writer went away. Returns its length.
+    std::size_t reset() {
+        const std::size_t dropped = m_size;
+        m_size = 0;
+        m_skipping = false;
+        return dropped;
+    }
+
+    std::size_t pending() const { return m_size; }
+    unsigned long long oversized() const { return m_oversized; }
+
+private:
+    std::unique_ptr<char[]> m_buffer;
+    const std::size_t m_capacity;
+    std::size_t m_size = 0;                  // Bytes of the unterminated line at the front
+    bool m_skipping = false;                 // Inside a line that did not fit
+    unsigned long long m_oversized = 0;      // Lines dropped for not fitting
+};
+
+#endif // AIRCLASS_LINE_FRAMER_HPP
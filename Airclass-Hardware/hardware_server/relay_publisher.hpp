@@ -0,0 +1,255 @@
+// Publishes gesture commands to one or more relays.
+//
+// Owns the WebSocketHardwareClient(s) and spreads commands over them
+// according to RelayMode. Shared by hardware_client (commands from the
+// Python recognizer's pipe or ring) and airclass_hardware (commands from the
+// in-process MediaPipe engine, see MediapipeCpp/airclass_hardware_main.cc),
+// together with the command-line/environment options both accept.
+
+#ifndef AIRCLASS_RELAY_PUBLISHER_HPP
+#define AIRCLASS_RELAY_PUBLISHER_HPP
+
+#include <algorithm>                               // std::max
+#include <chrono>                                  // std::chrono::milliseconds, std::chrono::steady_clock
+#include <condition_variable>                      // std::condition_variable
+#include <cstdint>                                 // std::uint32_t
+#include <cstdlib>                                 // std::getenv
+#include <memory>                                  // std::unique_ptr, std::make_unique
+#include <mutex>                                   // std::mutex, std::lock_guard, std::unique_lock
+#include <sstream>                                 // std::stringstream
+#include <string>                                  // std::string
+#include <vector>                                  // std::vector
+
+// WebSocket client that publishes gestures to one relay
+#include "websocket_hardware_client.hpp"
+
+// How commands are spread over several relays (AIRCLASS_RELAY_MODE)
+enum class RelayMode {
+    Failover,  // One connection, moving down the list when a relay fails
+    Standby,   // A connection to every relay; commands go to the first healthy one
+    Active     // A connection to every relay; every command goes to all of them
+};
+
+// Where and how to publish
+struct RelayOptions {
+    std::vector<std::string> uris{"ws://localhost:8080"};  // Relays, primary first
+    std::string clientId = "hardware-pi-01";               // Hardware client ID
+    std::string room;                                      // Empty = relay's default room
+    RelayMode mode = RelayMode::Failover;                  // How several relays are used
+    bool tracing = false;                                  // Attach per-hop latency to commands
+    int heartbeatMs = 2000;                                // Relay ping interval (watchdog: 3x)
+    int spoolLimit = 32;                                   // Commands kept while the relay is away
+    int spoolTtlMs = 10000;                                // Older spooled commands are dropped;
+                                                           // above the watchdog, see setSpool()
+};
+
+// Reads a positive integer from the environment, keeping the default when
+// unset or invalid
+inline void readEnvInt(const char* name, int minimum, int& value) {
+    const char* text = std::getenv(name);
+    if (!text) return;
+    try {
+        value = std::max(minimum, std::stoi(text));
+    } catch (...) {
+        AC_LOG(Warn) << "Invalid " << name << " env var, using default " << value << ".";
+    }
+}
+
+// Fills options from [uri[,uri...]] [clientId] [room] on the command line and
+// the AIRCLASS_* environment. Returns false when no relay URI is left.
+inline bool readRelayOptions(int argc, char* argv[], RelayOptions& options) {
+    // Room can come from the environment so start scripts need no extra args
+    if (const char* env_room = std::getenv("AIRCLASS_ROOM")) options.room = env_room;
+    if (const char* env_trace = std::getenv("AIRCLASS_TRACE")) options.tracing = std::string(env_trace) == "1";
+    // Several relays: "failover" (default), "standby" or "active"
+    if (const char* env_mode = std::getenv("AIRCLASS_RELAY_MODE")) {
+        const std::string mode = env_mode;
+        if (mode == "standby") {
+            options.mode = RelayMode::Standby;
+        } else if (mode == "active") {
+            options.mode = RelayMode::Active;
+        } else if (mode != "failover") {
+            AC_LOG(Warn) << "Unknown AIRCLASS_RELAY_MODE " << mode << ", using failover.";
+        }
+    }
+    readEnvInt("AIRCLASS_HEARTBEAT_MS", 100, options.heartbeatMs);
+    readEnvInt("AIRCLASS_SPOOL_LIMIT", 1, options.spoolLimit);
+    readEnvInt("AIRCLASS_SPOOL_TTL_MS", 0, options.spoolTtlMs);
+
+    // Override defaults via command-line arguments. Several relays can be
+    // given comma-separated, primary first.
+    if (argc > 1) {
+        options.uris.clear();
+        std::stringstream uriList(argv[1]);
+        for (std::string uri; std::getline(uriList, uri, ',');) {
+            if (!uri.empty()) options.uris.push_back(uri);
+        }
+    }
+    if (argc > 2) options.clientId = argv[2];
+    if (argc > 3) options.room     = argv[3];
+    return !options.uris.empty();
+}
+
+inline void logRelayOptions(const RelayOptions& options) {
+    std::string uris;
+    for (const std::string& uri : options.uris) {
+        uris += (uris.empty() ? "" : ",") + uri;
+    }
+    AC_LOG(Info) << "Server URI: " << uris;
+    AC_LOG(Info) << "Client ID : " << options.clientId;
+    AC_LOG(Info) << "Room      : " << (options.room.empty() ? "(default)" : options.room);
+    AC_LOG(Info) << "Tracing   : " << (options.tracing ? "on" : "off");
+    AC_LOG(Info) << "Relays    : " << options.uris.size() << " ("
+                 << (options.mode == RelayMode::Active ? "active-active" :
+                     options.mode == RelayMode::Standby ? "primary/standby" : "failover") << ")";
+    AC_LOG(Info) << "Heartbeat : " << options.heartbeatMs << " ms (watchdog " << 3 * options.heartbeatMs << " ms)";
+    AC_LOG(Info) << "Spool     : " << options.spoolLimit << " commands, " << options.spoolTtlMs << " ms TTL";
+    if (options.spoolTtlMs <= 3 * options.heartbeatMs) {
+        AC_LOG(Warn) << "Spool TTL is not above the watchdog; commands lost on a dead connection expire unsent.";
+    }
+}
+
+class RelayPublisher {
+public:
+    explicit RelayPublisher(const RelayOptions& options)
+        : m_mode(options.mode)
+        , m_heartbeat(options.heartbeatMs)
+    {
+        if (m_mode == RelayMode::Failover) {
+            m_relays.push_back(std::make_unique<WebSocketHardwareClient>(options.uris, options.clientId, options.room));
+        } else {
+            for (const std::string& uri : options.uris) {
+                m_relays.push_back(std::make_unique<WebSocketHardwareClient>(uri, options.clientId, options.room));
+            }
+        }
+        // A standby relay takes over once the active one missed about one heartbeat
+        for (auto& relay : m_relays) {
+            relay->setTracing(options.tracing);
+            relay->setHeartbeat(m_heartbeat, m_heartbeat * 3);
+            relay->setSpool(static_cast<std::size_t>(options.spoolLimit),
+                            std::chrono::milliseconds(options.spoolTtlMs));
+            relay->setOnRegistered([this]() { onRegistered(); });
+        }
+    }
+
+    ~RelayPublisher() {
+        stop();  // Joins the ASIO threads before the registration callback's target goes away
+    }
+
+    // Starts every relay connection at once, then waits up to 10s in total
+    // for one of them to register. A relay that is not reachable yet is not
+    // fatal: its client keeps retrying and spools commands meanwhile.
+    void connect() {
+        AC_LOG(Info) << "Attempting WebSocket connection...";
+        for (auto& relay : m_relays) relay->start();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_registered.wait_for(lock, std::chrono::seconds(10), [this]() { return anyRegistered(); });
+        }
+        std::size_t connected = 0;
+        for (const auto& relay : m_relays) {
+            if (relay->isConnected()) connected++;
+        }
+        if (connected == 0) {
+            AC_LOG(Warn) << "Relay not reachable yet; gestures are spooled or dropped until it is.";
+        } else if (connected < m_relays.size()) {
+            AC_LOG(Warn) << connected << " of " << m_relays.size() << " relays reachable; retrying the rest.";
+        }
+    }
+
+    void stop() {
+        for (auto& relay : m_relays) relay->stop();
+    }
+
+    // Sends one command. While the relay is unreachable the client spools
+    // discrete commands and drops positions. Call from one thread; relays
+    // registering on their own threads only take m_mutex.
+    //
+    // The seq and capture time are fixed here, so every relay forwards the
+    // command with the same ones and a desktop that receives it twice (over
+    // two relays, or after switching relays) handles it once.
+    bool send(CommandType cmd_type, const json& position_data, const CommandTrace& trace) {
+        CommandTrace stamped = trace;
+        if (!stamped.has_seq) {
+            stamped.has_seq = true;
+            stamped.seq = m_nextSeq++;
+        }
+        if (stamped.capture_us == 0) {
+            stamped.capture_us = steadyNowUs();
+        }
+
+        if (m_mode != RelayMode::Active) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return selectRelay().sendCommand(cmd_type, position_data, stamped);
+        }
+        bool sent = false;
+        for (auto& relay : m_relays) {
+            sent = relay->sendCommand(cmd_type, position_data, stamped) || sent;
+        }
+        return sent;
+    }
+
+    bool anyRegistered() const {
+        for (const auto& relay : m_relays) {
+            if (relay->isRegistered()) return true;
+        }
+        return false;
+    }
+
+    bool anyConnected() const {
+        for (const auto& relay : m_relays) {
+            if (relay->isConnected()) return true;
+        }
+        return false;
+    }
+
+private:
+    // A relay confirmed a registration (ASIO thread of its client). Wakes
+    // connect(), and lets a standby that registers while the active relay is
+    // down take over that relay's commands now rather than at the next send.
+    void onRegistered() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_mode == RelayMode::Standby) selectRelay();
+        m_registered.notify_all();
+    }
+
+    // Relay a command goes to when not sending to all of them: the first
+    // healthy one in list order, so traffic returns to the primary once it
+    // is back. With none healthy, the first registered one, else the primary
+    // (whose spool keeps discrete commands). On a switch, the commands the
+    // previous relay may not have delivered (its spool, and those sent while
+    // it was already silent) go to the new one; desktops drop any copy by
+    // seq and capture_us. Caller holds m_mutex.
+    WebSocketHardwareClient& selectRelay() {
+        const std::chrono::milliseconds max_silence = m_heartbeat + m_heartbeat / 2;
+        std::size_t chosen = m_relays.size();
+        for (std::size_t i = 0; i < m_relays.size() && chosen == m_relays.size(); ++i) {
+            if (m_relays[i]->isHealthy(max_silence)) chosen = i;
+        }
+        for (std::size_t i = 0; i < m_relays.size() && chosen == m_relays.size(); ++i) {
+            if (m_relays[i]->isRegistered()) chosen = i;
+        }
+        if (chosen == m_relays.size()) chosen = 0;
+        if (chosen != m_activeRelay) {
+            AC_LOG(Warn) << (chosen == 0 ? "Back on the primary relay" : "Switching to standby relay ")
+                         << (chosen == 0 ? "" : std::to_string(chosen));
+            const auto pending = m_relays[m_activeRelay]->takePending();
+            if (!pending.empty()) {
+                AC_LOG(Info) << "Handing " << pending.size() << " undelivered command(s) to the new relay";
+                m_relays[chosen]->adoptPending(pending);
+            }
+            m_activeRelay = chosen;
+        }
+        return *m_relays[chosen];
+    }
+
+    const RelayMode            m_mode;             // How commands are spread over m_relays
+    std::vector<std::unique_ptr<WebSocketHardwareClient>> m_relays;  // Underlying WS clients, primary first
+    const std::chrono::milliseconds m_heartbeat;   // Relay ping interval
+    std::size_t                m_activeRelay = 0;  // Relay selectRelay() chose last (guarded by m_mutex)
+    std::mutex                 m_mutex;            // Guards relay selection and handover
+    std::condition_variable    m_registered;       // Signalled when a relay registers
+    std::uint32_t              m_nextSeq = 0;      // Seq of the next command without one
+};
+
+#endif // AIRCLASS_RELAY_PUBLISHER_HPP
@@ -0,0 +1,129 @@
+// Microbenchmark of the hardware client's JSON command rendering.
+//
+// Renders the messages WebSocketHardwareClient sends to a relay that did not
+// accept binary frames, once through nlohmann::json (build + dump, the old
+// path) and once through CommandSerializer, for three shapes: a bare
+// command, a command with a position, and a traced command with a position.
+// Every fast message is parsed back and compared with the nlohmann one
+// before timing. Reports ns and bytes per message.
+//
+// Usage:
+//   serializer_bench [--messages 1000000]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "command_serializer.hpp"
+
+namespace {
+
+using json = nlohmann::json;
+using airclass::CommandSerializer;
+
+enum class Shape { Command, Position, Traced };
+
+struct Sample {
+    airclass::CommandType command;
+    CommandSerializer::Position position;
+    CommandSerializer::Trace trace;
+};
+
+Sample makeSample(std::uint32_t i) {
+    Sample sample;
+    sample.command = static_cast<airclass::CommandType>(i % airclass::kCommandCount);
+    sample.position.x = 0.25 + 0.5 * ((i * 37) % 1000) / 1000.0;
+    sample.position.y = 0.25 + 0.5 * ((i * 91) % 1000) / 1000.0;
+    sample.trace = {i, 1000000ull + i * 16667ull, 800 + i % 300, 40 + i % 20};
+    return sample;
+}
+
+std::string renderJson(const Sample& sample, Shape shape) {
+    json message = {{"command", std::string(airclass::commandName(sample.command))}};
+    if (shape != Shape::Command) {
+        message["position"] = {{"x", sample.position.x}, {"y", sample.position.y}};
+    }
+    if (shape == Shape::Traced) {
+        message["seq"] = sample.trace.seq;
+        message["capture_us"] = sample.trace.capture_us;
+        message["trace"] = {{"pipe_us", sample.trace.pipe_us}, {"hw_us", sample.trace.hw_us}};
+    }
+    return message.dump();
+}
+
+std::string_view renderFast(const Sample& sample, Shape shape, char (&buffer)[CommandSerializer::kMaxMessage]) {
+    return CommandSerializer::instance().render(sample.command,
+                                                shape != Shape::Command ? &sample.position : nullptr,
+                                                shape == Shape::Traced ? &sample.trace : nullptr, buffer);
+}
+
+// Keeps the optimizer from dropping the rendered messages
+std::size_t g_sink = 0;
+
+template <typename Render>
+double timeNs(std::uint32_t messages, std::uint64_t& bytes, Render&& render) {
+    bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint32_t i = 0; i < messages; ++i) {
+        const std::size_t size = render(i);
+        bytes += size;
+        g_sink += size;
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / messages;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::uint32_t messages = 1000000;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--messages" && i + 1 < argc) {
+            messages = static_cast<std::uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            std::cerr << "Usage: serializer_bench [--messages N]\n";
+            return 2;
+        }
+    }
+
+    const struct { Shape shape; const char* name; } shapes[] = {
+        {Shape::Command, "command"},
+        {Shape::Position, "command+position"},
+        {Shape::Traced, "command+position+trace"},
+    };
+
+    // Both paths must produce the same JSON document
+    char buffer[CommandSerializer::kMaxMessage];
+    for (const auto& entry : shapes) {
+        for (std::uint32_t i = 0; i < 10000; ++i) {
+            const Sample sample = makeSample(i);
+            const std::string_view fast = renderFast(sample, entry.shape, buffer);
+            if (json::parse(fast.begin(), fast.end()) != json::parse(renderJson(sample, entry.shape))) {
+                std::cerr << "Mismatch for " << entry.name << ": " << fast << "\n";
+                return 1;
+            }
+        }
+    }
+
+    std::printf("%u messages per run\n\n", messages);
+    std::printf("%-24s %14s %14s %10s %12s\n", "shape", "nlohmann ns", "fast ns", "speedup", "bytes/msg");
+    for (const auto& entry : shapes) {
+        std::uint64_t json_bytes = 0;
+        std::uint64_t fast_bytes = 0;
+        const double json_ns = timeNs(messages, json_bytes, [&](std::uint32_t i) {
+            return renderJson(makeSample(i), entry.shape).size();
+        });
+        const double fast_ns = timeNs(messages, fast_bytes, [&](std::uint32_t i) {
+            return renderFast(makeSample(i), entry.shape, buffer).size();
+        });
+        std::printf("%-24s %14.1f %14.1f %9.1fx %12.1f\n", entry.name, json_ns, fast_ns, json_ns / fast_ns,
+                    static_cast<double>(fast_bytes) / messages);
+    }
+    return g_sink == 0;
+}
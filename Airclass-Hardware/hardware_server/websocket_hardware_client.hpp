@@ -0,0 +1,795 @@
+// WebSocket client used by the hardware side to publish gestures to the relay.
+//
+// Connects, registers as a "hardware" client (offering binary gesture frames)
+// and sends commands as binary frames or JSON, whichever the relay accepted.
+// A supervisor on the ASIO thread keeps the connection up: it pings the relay,
+// drops a connection that stops answering, and reconnects forever with
+// jittered exponential backoff, failing over across the configured relays.
+// Discrete commands issued while the relay is unreachable are spooled
+// (bounded, with a TTL so a stale "next" does not fire minutes later) and
+// sent in order once the relay has confirmed the next registration;
+// positions are dropped instead. A half-open connection accepts sends until
+// the watchdog notices it, so sent commands are also kept until a heartbeat
+// shows the relay got them, and go out again after the next registration.
+// Used by hardware_client.cpp and by the relay benchmark
+// (server/relay_bench.cpp).
+
+#ifndef AIRCLASS_WEBSOCKET_HARDWARE_CLIENT_HPP
+#define AIRCLASS_WEBSOCKET_HARDWARE_CLIENT_HPP
+
+#include <websocketpp/config/asio_no_tls.hpp>      // WebSocket++ config for non-TLS (plain WS)
+#include <websocketpp/client.hpp>                  // WebSocket++ client implementation
+#include <string>                                  // std::string
+#include <string_view>                             // std::string_view
+#include <thread>                                  // std::thread, std::this_thread::sleep_for
+#include <mutex>                                   // std::mutex, std::lock_guard, std::unique_lock
+#include <condition_variable>                      // std::condition_variable
+#include <chrono>                                  // std::chrono::seconds, std::chrono::milliseconds
+#include <atomic>                                  // std::atomic<bool>
+#include <cstdint>                                 // std::uint32_t, std::uint64_t
+#include <cstdlib>                                 // std::strtoull
+#include <stdexcept>                               // std::exception, std::invalid_argument
+#include <algorithm>                               // std::min
+#include <functional>                              // std::function
+#include <deque>                                   // std::deque
+#include <random>                                  // std::mt19937, std::uniform_int_distribution
+#include <vector>                                  // std::vector
+
+// JSON library for message parsing and serialization
+#include <nlohmann/json.hpp>
+
+// Asynchronous console logger shared with the relay server
+#include "airclass_log.hpp"
+// Command table and binary frame format shared with the relay and the desktop
+#include "gesture_commands.hpp"
+#include "gesture_frame.hpp"
+// Allocation-free JSON rendering of commands
+#include "command_serializer.hpp"
+
+// Convenience aliases for JSON and WebSocket++ placeholders
+using json = nlohmann::json;
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::connection_hdl;
+
+// Define the WebSocket++ client type using ASIO transport without TLS
+typedef websocketpp::client<websocketpp::config::asio> client;
+typedef client::message_ptr message_ptr;
+
+// Gesture command identifiers shared with the relay and the desktop
+using airclass::CommandType;
+
+// Monotonic time in microseconds. On Linux this is CLOCK_MONOTONIC, the same
+// clock Python's time.monotonic_ns() and the MediaPipe recognizer stamp with.
+inline std::uint64_t steadyNowUs() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Where a command came from, for end-to-end latency tracing
+struct CommandTrace {
+    bool has_seq = false;         // Recognizer supplied a sequence number
+    std::uint32_t seq = 0;        // Recognizer sequence number
+    std::uint64_t capture_us = 0; // Camera frame time (0 = unknown)
+    std::uint64_t read_us = 0;    // When we read the line from the pipe (0 = unknown)
+};
+
+class WebSocketHardwareClient {
+public:
+    // A discrete command waiting for the relay, or sent but not yet known
+    // to have arrived
+    struct SpooledCommand {
+        CommandType                           command;
+        CommandTrace                          trace;     // Keeps its original seq and capture time
+        std::chrono::steady_clock::time_point spooled;   // First issued, for the TTL
+        std::chrono::steady_clock::time_point sent;      // Last handed to a connection
+    };
+
+    // Constructor: store URI, clientId and room, initialize state flags
+    WebSocketHardwareClient(std::string uri, std::string clientId, std::string room = "")
+        : WebSocketHardwareClient(std::vector<std::string>{std::move(uri)}, std::move(clientId), std::move(room))
+    {}
+
+    // Same, with relays to fail over across, tried in order
+    WebSocketHardwareClient(std::vector<std::string> uris, std::string clientId, std::string room = "")
+        : m_uris(std::move(uris))
+        , m_clientId(std::move(clientId))
+        , m_room(std::move(room))
+        , m_connected(false)
+        , m_connecting(false)
+        , m_reconnect_attempts(0)
+        , m_reconnect_delay_ms(500)
+        , m_max_reconnect_delay_ms(30000)
+        , m_stop_requested(false)
+        , m_jitter(std::random_device{}())
+    {
+        // Reduce logging verbosity
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.set_access_channels(websocketpp::log::alevel::connect);
+        m_client.set_access_channels(websocketpp::log::alevel::disconnect);
+        m_client.set_access_channels(websocketpp::log::alevel::app);
+
+        // Initialize ASIO I/O service
+        m_client.init_asio();
+
+        // Register event handlers
+        m_client.set_open_handler(bind(&WebSocketHardwareClient::on_open, this, _1));
+        m_client.set_close_handler(bind(&WebSocketHardwareClient::on_close, this, _1));
+        m_client.set_fail_handler(bind(&WebSocketHardwareClient::on_fail, this, _1));
+        m_client.set_message_handler(bind(&WebSocketHardwareClient::on_message, this, _1, _2));
+        m_client.set_pong_handler(bind(&WebSocketHardwareClient::on_pong, this, _1, _2));
+
+        if (m_uris.empty()) {
+            throw std::invalid_argument("WebSocketHardwareClient needs at least one relay URI");
+        }
+    }
+
+    // Destructor: ensure graceful shutdown if still running
+    ~WebSocketHardwareClient() {
+        if (!m_stop_requested) {
+            stop();
+        }
+    }
+
+    // Start the connection supervisor and wait up to 10s for the first
+    // connection. Returns whether it is up; either way the supervisor keeps
+    // (re)connecting on the ASIO thread until stop().
+    bool connect() {
+        if (!start()) return false;
+        try {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_cond.wait_for(lock, std::chrono::seconds(10),
+                                 [this]{ return m_connected || m_stop_requested; })) {
+                AC_LOG(Warn) << "No relay reachable yet; still retrying in the background.";
+            }
+            return m_connected;
+
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Exception during connect(): " << e.what();
+            return false;
+        }
+    }
+
+    // Start the connection supervisor without waiting for it. Returns false
+    // after stop() or if the ASIO thread cannot be started.
+    bool start() {
+        if (m_stop_requested) return false;
+
+        try {
+            // Launch the ASIO run loop once. Perpetual, so it keeps running
+            // between connections; every attempt after this one is started
+            // from its timers.
+            if (!m_client_thread.joinable()) {
+                m_client.start_perpetual();
+                m_client.get_io_service().post([this]() {
+                    if (!startConnect()) schedule_reconnect();
+                });
+                m_client_thread = std::thread([this]() {
+                    try {
+                        m_client.run();
+                    } catch (const std::exception& e) {
+                        AC_LOG(Error) << "Exception in ASIO run loop: " << e.what();
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_connected = false;
+                        m_connecting = false;
+                        m_cond.notify_all();
+                    }
+                });
+            }
+            return true;
+
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Exception during start(): " << e.what();
+            return false;
+        }
+    }
+
+    // Stop the WebSocket client: close connection and join thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop_requested) return;
+            m_stop_requested = true;
+        }
+        m_cond.notify_all();  // Release a connect() still waiting
+
+        // If currently connected, send a close frame
+        if (m_connected) {
+            websocketpp::lib::error_code ec;
+            AC_LOG(Info) << "Closing WebSocket connection...";
+            try {
+                const connection_hdl hdl = currentHandle();
+                if (!hdl.expired()) {
+                    m_client.close(hdl, websocketpp::close::status::going_away, "Client shutdown", ec);
+                    if (ec) {
+                        AC_LOG(Error) << "Error closing connection: " << ec.message();
+                    }
+                }
+            } catch (const std::exception& e) {
+                AC_LOG(Error) << "Exception while closing connection: " << e.what();
+            }
+        }
+        m_connected = false;
+        m_connecting = false;
+
+        // Stop ASIO event loop; pending supervisor timers never fire
+        try {
+            AC_LOG(Info) << "Stopping WebSocket ASIO service...";
+            m_client.stop_perpetual();
+            m_client.stop();
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Exception during client stop(): " << e.what();
+        }
+
+        // Wait for the ASIO thread to finish
+        if (m_client_thread.joinable()) {
+            AC_LOG(Info) << "Waiting for ASIO thread to join...";
+            m_client_thread.join();
+            AC_LOG(Info) << "WebSocket client ASIO thread joined.";
+        }
+    }
+
+    // Send a gesture command to the server. Uses the compact binary frame once
+    // the relay has accepted it at registration, JSON otherwise. With tracing
+    // on, the time spent in the pipe and in this process travels along.
+    //
+    // Until the relay has confirmed registration (or when sending fails), a
+    // discrete command is spooled for redelivery and true is returned; a
+    // position is dropped and false is returned. A discrete command sent
+    // directly is sent again after the next registration unless a heartbeat
+    // answered in the meantime; desktops drop the copy by seq and capture_us.
+    bool sendCommand(CommandType command_type, const json& position_data = json(),
+                     const CommandTrace& trace = CommandTrace()) {
+        if (command_type == CommandType::UNKNOWN) return false;
+
+        CommandTrace stamped = trace;
+        if (!stamped.has_seq) {
+            stamped.has_seq = true;
+            stamped.seq = m_next_seq.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (stamped.capture_us == 0) {
+            stamped.capture_us = steadyNowUs();
+        }
+
+        if (!position_data.empty()) {
+            // A stale position is worthless; the next one replaces it
+            return m_registered && transmit(command_type, position_data, stamped);
+        }
+
+        // Registered is only set once the spool is empty, so nothing sent
+        // directly can overtake a spooled command
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (m_registered && transmit(command_type, position_data, stamped)) {
+            rememberSent({command_type, stamped, now, now});
+            return true;
+        }
+        if (m_spool.size() >= m_spool_limit) {
+            m_spool.pop_front();
+            m_spool_dropped++;
+            AC_LOG_RATE(Warn, 5) << "Command spool full; dropped the oldest command ("
+                                 << m_spool_dropped << " dropped so far)";
+        }
+        m_spool.push_back({command_type, stamped, now, {}});
+        AC_LOG_RATE(Info, 5) << "Relay not ready; spooled " << commandTypeToString(command_type)
+                             << " (" << m_spool.size() << " waiting)";
+        return true;
+    }
+
+    // Check current connection state
+    bool isConnected() const {
+        return m_connected;
+    }
+
+    // Attach per-hop latency to every command (AIRCLASS_TRACE)
+    void setTracing(bool enabled) {
+        m_tracing = enabled;
+    }
+
+    // Relay confirmed registration and the spool has been flushed
+    bool isRegistered() const {
+        return m_registered;
+    }
+
+    // Registered with the relay, which acked within max_silence. Used to
+    // pick among hot-standby relays.
+    bool isHealthy(std::chrono::milliseconds max_silence) const {
+        if (!m_registered) return false;
+        const std::uint64_t last_ack_us = m_last_ack_us.load();
+        const std::uint64_t now_us = steadyNowUs();
+        return now_us <= last_ack_us
+            || now_us - last_ack_us <= static_cast<std::uint64_t>(max_silence.count()) * 1000;
+    }
+
+    // Ping the relay every interval and drop the connection when nothing
+    // came back for timeout (AIRCLASS_HEARTBEAT_MS). Call before connect().
+    void setHeartbeat(std::chrono::milliseconds interval, std::chrono::milliseconds timeout) {
+        m_heartbeat_ms = std::max<long>(1, static_cast<long>(interval.count()));
+        m_watchdog_ms = std::max<long>(m_heartbeat_ms, static_cast<long>(timeout.count()));
+    }
+
+    // Bound the offline spool: at most limit commands, none older than ttl
+    // when the relay comes back (AIRCLASS_SPOOL_LIMIT, AIRCLASS_SPOOL_TTL_MS).
+    // The same bounds apply to sent commands kept for a resend; ttl should
+    // exceed the watchdog timeout, or a command lost on a half-open
+    // connection expires before it is noticed.
+    void setSpool(std::size_t limit, std::chrono::milliseconds ttl) {
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        m_spool_limit = std::max<std::size_t>(1, limit);
+        m_spool_ttl = ttl;
+    }
+
+    // Called on the ASIO thread whenever the relay confirmed a registration
+    // and the spool went out. Set before connect().
+    void setOnRegistered(std::function<void()> callback) {
+        m_on_registered = std::move(callback);
+    }
+
+    // Takes the discrete commands this relay may not have delivered: the
+    // unacknowledged sent ones and the spool, oldest first, without expired
+    // ones. For handing them to another relay (see adoptPending).
+    std::deque<SpooledCommand> takePending() {
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        pruneSent(now);
+        std::deque<SpooledCommand> pending;
+        pending.swap(m_sent);
+        pending.insert(pending.end(), m_spool.begin(), m_spool.end());
+        m_spool.clear();
+        while (!pending.empty() && now - pending.front().spooled > m_spool_ttl) pending.pop_front();
+        return pending;
+    }
+
+    // Sends commands taken from another relay ahead of anything spooled
+    // here: at once when registered, else after the next registration.
+    void adoptPending(const std::deque<SpooledCommand>& pending) {
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        m_spool.insert(m_spool.begin(), pending.begin(), pending.end());
+        while (m_spool.size() > m_spool_limit) {
+            m_spool.pop_front();
+            m_spool_dropped++;
+        }
+        if (m_registered) {
+            m_registered = false;  // Set again once the spool is out
+            flushSpoolLocked();
+        }
+    }
+
+    // Convert string command to CommandType enum (compile-time perfect hash)
+    static CommandType stringToCommandType(std::string_view command) {
+        return airclass::commandFromName(command);
+    }
+
+    // Binary gesture frame for a command. With traced set, the frame carries
+    // the time spent in the pipe and in this process up to now_us.
+    static airclass::GestureFrame toFrame(CommandType command_type, const json& position_data,
+                                          const CommandTrace& trace, bool traced, std::uint64_t now_us) {
+        airclass::GestureFrame frame;
+        frame.command = command_type;
+        frame.seq = trace.seq;
+        frame.capture_us = trace.capture_us;
+        if (traced) {
+            frame.flags |= airclass::kFlagTrace;
+            frame.pipe_us = elapsedUs(trace.capture_us, trace.read_us);
+            frame.hw_us = elapsedUs(trace.read_us, now_us);
+        }
+        if (position_data.is_object()) {
+            if (position_data.contains("x") && position_data.contains("y")) {
+                frame.flags |= airclass::kFlagPosition;
+                frame.x = position_data["x"].get<double>();
+                frame.y = position_data["y"].get<double>();
+            }
+            if (position_data.contains("z")) {
+                frame.flags |= airclass::kFlagDepth;
+                frame.z = position_data["z"].get<double>();
+            }
+        }
+        return frame;
+    }
+
+    // Convert CommandType enum to the corresponding name, without allocating
+    static std::string_view commandTypeToString(CommandType command) {
+        return airclass::commandName(command);
+    }
+
+
+private:
+    // Writes one command to the current connection
+    bool transmit(CommandType command_type, const json& position_data, const CommandTrace& trace) {
+        if (!m_connected) return false;
+
+        const connection_hdl hdl = currentHandle();
+        const std::uint32_t seq = trace.seq;
+        const std::uint64_t now_us = steadyNowUs();
+        const std::uint64_t capture_us = trace.capture_us;
+        const bool traced = m_tracing && trace.read_us != 0;
+        const std::uint32_t pipe_us = traced ? elapsedUs(capture_us, trace.read_us) : 0;
+        const std::uint32_t hw_us = traced ? elapsedUs(trace.read_us, now_us) : 0;
+        airclass::CommandSerializer::Position position;
+
+        websocketpp::lib::error_code ec;
+        try {
+            if (hdl.expired()) {
+                return false;
+            }
+            const int binary_version = m_binary_version.load();
+            if (binary_version >= 1) {
+                const airclass::GestureFrame frame =
+                    toFrame(command_type, position_data, trace, traced && binary_version >= 2, now_us);
+                unsigned char buffer[airclass::kMaxFrameSize];
+                const std::size_t length = airclass::encodeFrame(frame, buffer);
+                m_client.send(hdl, buffer, length, websocketpp::frame::opcode::binary, ec);
+            } else if (toPosition(position_data, position)) {
+                // Fixed-shape message: rendered straight into a stack buffer.
+                // seq and capture_us always go along, so desktops can drop the
+                // second copy of a command published to several relays.
+                const airclass::CommandSerializer::Trace trace_fields{seq, capture_us, pipe_us, hw_us, traced};
+                char buffer[airclass::CommandSerializer::kMaxMessage];
+                const std::string_view message = airclass::CommandSerializer::instance().render(
+                    command_type, position_data.is_object() ? &position : nullptr, &trace_fields, buffer);
+                m_client.send(hdl, message.data(), message.size(), websocketpp::frame::opcode::text, ec);
+            } else {
+                // Arbitrary position payload: build the JSON message generically
+                json message = {
+                    {"command", std::string(commandTypeToString(command_type))},
+                };
+
+                // Add position data if provided (for tracking commands)
+                if (!position_data.empty()) {
+                    message["position"] = position_data;
+                }
+                message["seq"] = seq;
+                message["capture_us"] = capture_us;
+                if (traced) {
+                    message["trace"] = {{"pipe_us", pipe_us}, {"hw_us", hw_us}};
+                }
+                m_client.send(hdl, message.dump(), websocketpp::frame::opcode::text, ec);
+            }
+        } catch (const std::exception& e) {
+            AC_LOG_RATE(Error, 5) << "Exception during sendCommand: " << e.what();
+            return false;
+        }
+
+        if (ec) {
+            AC_LOG_RATE(Error, 5) << "Error sending command: " << ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    // Sends the spooled commands in order, dropping expired ones, then lets
+    // new commands go out directly. Runs on the ASIO thread once the relay
+    // has confirmed registration.
+    void flushSpool() {
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        flushSpoolLocked();
+    }
+
+    // flushSpool() for a caller that holds m_spool_mutex
+    void flushSpoolLocked() {
+        const auto now = std::chrono::steady_clock::now();
+        std::size_t sent = 0;
+        std::size_t expired = 0;
+        while (!m_spool.empty()) {
+            const SpooledCommand& entry = m_spool.front();
+            if (now - entry.spooled > m_spool_ttl) {
+                expired++;
+            } else if (transmit(entry.command, json(), entry.trace)) {
+                SpooledCommand resent = entry;
+                resent.sent = std::chrono::steady_clock::now();
+                rememberSent(resent);
+                sent++;
+            } else {
+                // Lost the connection again; keep the rest for the next one
+                AC_LOG(Warn) << "Spool flush interrupted; " << m_spool.size() << " commands kept.";
+                return;
+            }
+            m_spool.pop_front();
+        }
+        m_registered = true;
+        if (sent > 0 || expired > 0) {
+            AC_LOG(Info) << "Spool flushed: " << sent << " commands redelivered, " << expired << " expired.";
+        }
+    }
+
+    // Stops direct sends until the next registration is confirmed. Sent
+    // commands the relay did not acknowledge go back to the front of the
+    // spool: the connection may have been half-open since they were sent.
+    void unregister() {
+        std::lock_guard<std::mutex> lock(m_spool_mutex);
+        m_registered = false;
+        pruneSent(std::chrono::steady_clock::now());
+        m_spool.insert(m_spool.begin(), m_sent.begin(), m_sent.end());
+        m_sent.clear();
+        while (m_spool.size() > m_spool_limit) {
+            m_spool.pop_front();
+            m_spool_dropped++;
+        }
+    }
+
+    // Keeps a command just sent until a heartbeat confirms it arrived.
+    // Caller holds m_spool_mutex.
+    void rememberSent(const SpooledCommand& entry) {
+        m_sent.push_back(entry);
+        pruneSent(entry.sent);
+    }
+
+    // Forgets sent commands that the relay acknowledged, that expired or
+    // that exceed the spool limit. Caller holds m_spool_mutex.
+    void pruneSent(std::chrono::steady_clock::time_point now) {
+        const std::chrono::steady_clock::time_point acked{std::chrono::microseconds(m_acked_us.load())};
+        while (!m_sent.empty() && (m_sent.front().sent < acked || now - m_sent.front().spooled > m_spool_ttl ||
+                                   m_sent.size() > m_spool_limit)) {
+            m_sent.pop_front();
+        }
+    }
+
+    // Handle of the current connection; written on the ASIO thread, read by senders
+    connection_hdl currentHandle() {
+        std::lock_guard<std::mutex> lock(m_hdl_mutex);
+        return m_hdl;
+    }
+
+    // Starts one connection attempt to the current relay without waiting for
+    // its outcome; on_open or on_fail follows. ASIO thread only.
+    bool startConnect() {
+        if (m_stop_requested) return false;
+        const std::string& uri = m_uris[m_uri_index];
+        m_connecting = true;
+        AC_LOG(Info) << "Attempting to connect to " << uri << "...";
+        websocketpp::lib::error_code ec;
+        // Create connection object
+        client::connection_ptr con = m_client.get_connection(uri, ec);
+        if (ec) {
+            AC_LOG(Error) << "Connect initialization error: " << ec.message();
+            m_connecting = false;
+            failOver();
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_hdl_mutex);
+            m_hdl = con->get_handle();
+        }
+        m_client.connect(con);
+        return true;
+    }
+
+    // Moves on to the next relay in the list for the next attempt
+    void failOver() {
+        if (m_uris.size() < 2) return;
+        m_uri_index = (m_uri_index + 1) % m_uris.size();
+        AC_LOG(Info) << "Failing over to " << m_uris[m_uri_index];
+    }
+
+    // Pings the relay every heartbeat and drops the connection once nothing
+    // (pong or message) has come back for the watchdog timeout. The close
+    // handler then reconnects to the next relay. ASIO thread only.
+    void schedule_heartbeat(connection_hdl hdl) {
+        m_heartbeat_timer = m_client.set_timer(m_heartbeat_ms, [this, hdl](const websocketpp::lib::error_code& ec) {
+            const auto con = hdl.lock();
+            if (ec || m_stop_requested || !m_connected || !con || con != currentHandle().lock()) {
+                return;  // Cancelled, shutting down or replaced by a newer connection
+            }
+            const std::uint64_t silent_ms = (steadyNowUs() - m_last_ack_us.load()) / 1000;
+            websocketpp::lib::error_code op_ec;
+            if (silent_ms > static_cast<std::uint64_t>(m_watchdog_ms)) {
+                AC_LOG(Warn) << "Relay silent for " << silent_ms << "ms; dropping the connection.";
+                m_watchdog_fired = true;
+                m_client.close(hdl, websocketpp::close::status::going_away, "Heartbeat timeout", op_ec);
+                return;
+            }
+            // The payload comes back in the pong: the relay has everything
+            // sent before this moment
+            m_client.ping(hdl, std::to_string(steadyNowUs()), op_ec);
+            if (op_ec) {
+                AC_LOG_RATE(Warn, 5) << "Heartbeat ping failed: " << op_ec.message();
+            }
+            schedule_heartbeat(hdl);
+        });
+    }
+
+    // Called when the WebSocket connection is successfully opened
+    void on_open(connection_hdl hdl) {
+        AC_LOG(Info) << "Connection established.";
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connected = true;
+            m_connecting = false;
+            m_reconnect_attempts = 0;
+        }
+        unregister();
+        m_binary_version = 0;  // JSON until this relay confirms binary support
+        m_last_ack_us = steadyNowUs();
+        m_watchdog_fired = false;
+        schedule_heartbeat(hdl);
+        m_cond.notify_all();
+
+        // Immediately send registration JSON to identify as hardware client
+        json registration_msg = {
+            {"register", "hardware"},
+            {"id", m_clientId},
+            {"binary", airclass::kFrameVersion}  // Offer binary frames; relay confirms
+        };
+        if (!m_room.empty()) {
+            registration_msg["room"] = m_room;  // Relay routes our gestures to this room only
+        }
+        websocketpp::lib::error_code ec;
+        try {
+            if (!hdl.expired()) {
+                m_client.send(hdl, registration_msg.dump(), websocketpp::frame::opcode::text, ec);
+                if (ec) {
+                    AC_LOG(Error) << "Failed to send registration: " << ec.message();
+                } else {
+                    AC_LOG(Info) << "Sent registration request.";
+                }
+            }
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Exception sending registration: " << e.what();
+        }
+    }
+
+    // Called when the WebSocket handshake or connection fails
+    void on_fail(connection_hdl hdl) {
+        std::string error_msg = "N/A";
+        auto con = m_client.get_con_from_hdl(hdl);
+        if (con) {
+            error_msg = con->get_ec().message();
+        }
+        AC_LOG(Error) << "Connection attempt failed: " << error_msg;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connected = false;
+            m_connecting = false;
+        }
+        unregister();
+        m_cond.notify_all();
+        failOver();            // This relay is unreachable; try the next one
+        schedule_reconnect();
+    }
+
+    // Called when an established WebSocket connection closes
+    void on_close(connection_hdl hdl) {
+        std::string reason = "N/A";
+        auto con = m_client.get_con_from_hdl(hdl);
+        if (con) {
+            reason = con->get_remote_close_reason();
+        }
+        AC_LOG(Info) << "Connection closed. Reason: " << (reason.empty() ? "(unknown)" : reason);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connected = false;
+            m_connecting = false;
+        }
+        unregister();
+        m_cond.notify_all();
+        if (m_heartbeat_timer) {
+            m_heartbeat_timer->cancel();
+        }
+        if (!m_stop_requested) {
+            // A relay that went silent is skipped; after a clean close the
+            // same relay is retried first
+            if (m_watchdog_fired) failOver();
+            schedule_reconnect();
+        }
+    }
+
+    // Called when a message arrives from the server
+    void on_message(connection_hdl hdl, message_ptr msg) {
+        m_last_ack_us = steadyNowUs();
+        const std::string& payload = msg->get_payload();
+        AC_LOG(Info) << "Received message from server: " << payload;
+        try {
+            json data = json::parse(payload);
+            if (data.contains("type")) {
+                std::string type = data["type"];
+                if (type == "registration_success") {
+                    // Older relays do not echo "binary" and keep receiving JSON
+                    m_binary_version = std::min<int>(data.value("binary", 0), airclass::kFrameVersion);
+                    AC_LOG(Info) << "Registered successfully as ID: "
+                              << data.value("client_id", "[N/A]")
+                              << (m_binary_version > 0 ? " (binary frames)" : " (JSON frames)");
+                    flushSpool();
+                    if (m_on_registered) m_on_registered();
+                } else if (type == "error") {
+                    AC_LOG(Error) << "Server Error: "
+                              << data.value("message", "(No details)");
+                }
+            }
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Error processing server message: " << e.what();
+        }
+    }
+
+    // Called when the relay answers a heartbeat ping, with the ping's send time
+    void on_pong(connection_hdl, std::string payload) {
+        m_last_ack_us = steadyNowUs();
+        const std::uint64_t pinged_us = std::strtoull(payload.c_str(), nullptr, 10);
+        if (pinged_us > m_acked_us.load()) m_acked_us = pinged_us;
+    }
+
+    // Reads a position that the fast serializer can render: none, or an
+    // object of numeric x and y with an optional numeric z and nothing else
+    static bool toPosition(const json& data, airclass::CommandSerializer::Position& out) {
+        if (data.is_null()) return true;
+        if (!data.is_object()) return false;
+        const auto x = data.find("x");
+        const auto y = data.find("y");
+        const auto z = data.find("z");
+        const std::size_t fields = 2 + (z != data.end() ? 1 : 0);
+        if (x == data.end() || y == data.end() || data.size() != fields) return false;
+        if (!x->is_number() || !y->is_number() || (z != data.end() && !z->is_number())) return false;
+        out.x = x->get<double>();
+        out.y = y->get<double>();
+        out.has_z = z != data.end();
+        out.z = out.has_z ? z->get<double>() : 0.0;
+        return true;
+    }
+
+    // Duration between two monotonic stamps, clamped to the 32-bit trace fields
+    static std::uint32_t elapsedUs(std::uint64_t from_us, std::uint64_t to_us) {
+        if (to_us <= from_us) return 0;
+        return static_cast<std::uint32_t>(std::min<std::uint64_t>(to_us - from_us, UINT32_MAX));
+    }
+
+    // Schedule a reconnect attempt on the ASIO timer. Retries never stop;
+    // the delay doubles after every full pass over the relays, up to
+    // m_max_reconnect_delay_ms, and is drawn from its upper half, so clients
+    // dropped together by an access point hiccup do not all come back in the
+    // same instant. ASIO thread only.
+    void schedule_reconnect() {
+        if (m_stop_requested || m_connected || m_connecting) return;
+        m_reconnect_attempts++;
+        const int rounds = (m_reconnect_attempts - 1) / static_cast<int>(m_uris.size());
+        const long long ceiling = std::min<long long>(
+            m_max_reconnect_delay_ms, static_cast<long long>(m_reconnect_delay_ms) << std::min(rounds, 16));
+        const long long delay = std::uniform_int_distribution<long long>(ceiling / 2, ceiling)(m_jitter);
+        AC_LOG(Info) << "Reconnect attempt " << m_reconnect_attempts << " in " << delay << "ms...";
+        m_reconnect_timer = m_client.set_timer(delay, [this](const websocketpp::lib::error_code& ec) {
+            if (ec || m_stop_requested || m_connected || m_connecting) return;
+            if (!startConnect()) {
+                schedule_reconnect();
+            }
+        });
+    }
+
+    // Member variables for the WebSocket++ client, state flags, and synchronization
+    client                     m_client;                 // WebSocket++ client object
+    connection_hdl             m_hdl;                    // Handle to the active connection
+    std::mutex                 m_hdl_mutex;              // Guards m_hdl
+    std::thread                m_client_thread;          // Thread running the ASIO loop
+    std::vector<std::string>   m_uris;                   // Relay URIs (ws://...), in failover order
+    std::size_t                m_uri_index = 0;          // Relay of the current or next attempt (ASIO thread)
+    std::string                m_clientId;               // Unique hardware client ID
+    std::string                m_room;                   // Classroom to publish into (empty = relay default)
+    std::atomic<bool>          m_connected;              // True if handshake completed
+    std::atomic<bool>          m_connecting;             // True while attempting to connect
+    std::atomic<bool>          m_stop_requested;         // True when shutting down
+    std::atomic<int>           m_binary_version{0};      // Frame version the relay accepted (0 = JSON)
+    std::atomic<bool>          m_tracing{false};         // Send per-hop trace fields
+    std::atomic<std::uint32_t> m_next_seq{0};            // Sequence number of the next command
+    int                        m_reconnect_attempts;     // Retries since the last successful open
+    const int                  m_reconnect_delay_ms;     // Base delay between retries
+    const int                  m_max_reconnect_delay_ms; // Cap for the backoff
+    std::mt19937               m_jitter;                 // Backoff jitter (ASIO thread only)
+    client::timer_ptr          m_reconnect_timer;        // Pending reconnect attempt
+    client::timer_ptr          m_heartbeat_timer;        // Next heartbeat of the open connection
+    long                       m_heartbeat_ms = 2000;    // Ping interval
+    long                       m_watchdog_ms = 6000;     // Silence after which the connection is dropped
+    std::atomic<std::uint64_t> m_last_ack_us{0};         // Last pong or message from the relay
+    bool                       m_watchdog_fired = false; // The current connection was dropped for silence
+    std::mutex                 m_mutex;                  // Synchronizes state flags
+    std::condition_variable    m_cond;                   // Signals connect/open events
+
+    // Offline spool of discrete commands
+    std::atomic<bool>          m_registered{false};      // Relay confirmed registration and the spool is empty
+    std::mutex                 m_spool_mutex;            // Guards the spool and m_registered transitions
+    std::deque<SpooledCommand> m_spool;                  // Oldest first
+    std::size_t                m_spool_limit = 32;       // Commands kept at most
+    std::chrono::milliseconds  m_spool_ttl{10000};       // Older commands are dropped, not sent
+    std::deque<SpooledCommand> m_sent;                   // Sent, not yet acknowledged; oldest first
+    std::atomic<std::uint64_t> m_acked_us{0};            // Everything sent before this reached the relay
+    std::function<void()>      m_on_registered;          // See setOnRegistered()
+    unsigned long long         m_spool_dropped = 0;      // Commands pushed out by a full spool
+};
+
+#endif // AIRCLASS_WEBSOCKET_HARDWARE_CLIENT_HPP
@@ -0,0 +1,1783 @@
+// The AirClass relay: accepts hardware and desktop WebSocket connections and
+// forwards each hardware client's gestures to the desktops of its room.
+//
+// Header-only so the relay can run on its own (websocket_server.cpp) or
+// embedded in the hardware client, which then publishes its gestures in
+// memory instead of over a loopback connection (see publish_local()).
+
+#ifndef AIRCLASS_SERVER_HPP
+#define AIRCLASS_SERVER_HPP
+
+// Include WebSocket++ headers (ASIO transport, no TLS for simplicity)
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+// Standard Library includes
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <array>
+#include <cctype>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <sstream>
+
+// POSIX: mkdir for the replay log's default directory
+#include <sys/stat.h>
+
+// JSON library for message parsing/serialization
+#include <nlohmann/json.hpp>
+
+// Asynchronous console logger shared with the hardware client
+#include "airclass_log.hpp"
+// Binary gesture frame format shared with the hardware client and the desktop
+#include "gesture_frame.hpp"
+// Log-linear histograms for the /metrics endpoint
+#include "latency_histogram.hpp"
+// Memory-mapped log of recent commands for reconnecting desktops
+#include "replay_log.hpp"
+// Optional permessage-deflate (AIRCLASS_DEFLATE build option)
+#include "websocket_deflate.hpp"
+
+// Convenient aliases
+using json = nlohmann::json;
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::connection_hdl;
+
+// Define our server type using WebSocket++ with ASIO
+typedef websocketpp::server<airclass::WithDeflate<websocketpp::config::asio>> server;
+typedef server::message_ptr message_ptr;
+
+// Simplified enumeration of client roles - we only care about hardware and desktop
+enum class ClientType : std::uint8_t {
+    HARDWARE,
+    DESKTOP,
+    UNKNOWN // Before the client registers
+};
+
+struct PositionThrottle;
+
+// Registration data of a connection. Lives inline in the connection's
+// ClientSlot and is only touched from that connection's handlers, which
+// WebSocket++ runs one at a time (per-connection strand).
+struct ClientInfo {
+    std::string id = "";                    // Client-provided unique ID
+    std::string room = "";                  // Classroom this client belongs to
+    int binary = 0;                         // Negotiated binary frame version (0 = JSON only)
+    std::shared_ptr<PositionThrottle> throttle;  // Hardware only; timers hold weak references
+};
+
+// Per-connection state, recycled across connections. The role is an inline
+// enum so on_message dispatches on it without a lookup or a refcount.
+struct ClientSlot {
+    std::atomic<ClientType> type{ClientType::UNKNOWN};  // Also read by stop() and /metrics
+    connection_hdl hdl;                                  // Set while the slot is in use
+    bool in_use = false;                                 // Guarded by the slab lock
+    ClientInfo info;                                     // Cleared, not freed, on release
+};
+
+// Pool of ClientSlots in fixed-size chunks. A connection takes a slot in
+// on_open and its index is bound into its message handler, so later lookups
+// are an index into a chunk: no map, no lock. Released slots go on a free list
+// and keep their string capacity, so a mass join after the first lecture
+// allocates nothing. Chunk pointers only ever go from null to set.
+class ClientSlab {
+public:
+    static constexpr std::uint32_t kChunkSlots = 256;
+    static constexpr std::uint32_t kMaxChunks = 256;    // 65536 concurrent connections
+    static constexpr std::uint32_t kNoSlot = UINT32_MAX;
+
+    ~ClientSlab() {
+        for (auto& chunk : m_chunks) delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    // Takes a free slot for hdl; kNoSlot when the pool is exhausted
+    std::uint32_t acquire(connection_hdl hdl) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::uint32_t index;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else {
+            if (m_next == kChunkSlots * kMaxChunks) return kNoSlot;
+            index = m_next++;
+            auto& chunk = m_chunks[index / kChunkSlots];
+            if (chunk.load(std::memory_order_relaxed) == nullptr) {
+                chunk.store(new ClientSlot[kChunkSlots], std::memory_order_release);
+            }
+        }
+        ClientSlot& slot = (*this)[index];
+        slot.hdl = hdl;
+        slot.in_use = true;
+        return index;
+    }
+
+    // Returns a slot to the pool; its registration data is cleared for reuse
+    void release(std::uint32_t index) {
+        ClientSlot& slot = (*this)[index];
+        slot.info.id.clear();
+        slot.info.room.clear();
+        slot.info.binary = 0;
+        slot.info.throttle.reset();
+        slot.type.store(ClientType::UNKNOWN, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(m_lock);
+        slot.hdl.reset();
+        slot.in_use = false;
+        m_free.push_back(index);
+    }
+
+    ClientSlot& operator[](std::uint32_t index) {
+        return m_chunks[index / kChunkSlots].load(std::memory_order_acquire)[index % kChunkSlots];
+    }
+
+    // Calls fn(ClientSlot&) for every slot in use, holding the slab lock
+    template <typename Fn>
+    void for_each_in_use(Fn&& fn) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (std::uint32_t index = 0; index < m_next; ++index) {
+            ClientSlot& slot = (*this)[index];
+            if (slot.in_use) fn(slot);
+        }
+    }
+
+private:
+    std::mutex m_lock;                                  // Free list and slot ownership
+    std::vector<std::uint32_t> m_free;                  // Released slot indices
+    std::uint32_t m_next = 0;                           // Slots handed out so far
+    std::array<std::atomic<ClientSlot*>, kMaxChunks> m_chunks{};
+};
+
+// Room used by clients that register without a "room" field
+const std::string DEFAULT_ROOM = "default";
+
+// How a forwarded message may be treated when a desktop falls behind
+enum class MessageClass {
+    POSITION,  // Continuous pointer/drawing updates: only the newest one matters
+    COMMAND,   // Discrete gestures (next_slide, zoom, ...): never dropped
+    BULK       // Anything else: oldest dropped first when the queue is full
+};
+
+// Caps for one desktop's outbound queue, read once from the environment.
+// Commands have their own cap; the others apply to positions and bulk only.
+struct OutboxLimits {
+    std::size_t max_messages = 256;          // AIRCLASS_OUTBOX_MESSAGES
+    std::size_t max_bytes = 256 * 1024;      // AIRCLASS_OUTBOX_BYTES
+    std::size_t max_commands = 1024;         // AIRCLASS_OUTBOX_COMMANDS: beyond this the desktop is closed
+    std::size_t socket_high_water = 64 * 1024;  // AIRCLASS_OUTBOX_HIGH_WATER: bytes websocketpp
+                                                // may hold for a desktop before we stop handing it more
+};
+
+// Relay-wide queue counters, summed over all desktops
+struct OutboxMetrics {
+    std::atomic<std::int64_t> queued_messages{0};    // Messages currently waiting in outboxes
+    std::atomic<std::int64_t> queued_bytes{0};       // Payload bytes currently waiting
+    std::atomic<std::int64_t> peak_depth{0};         // Deepest single outbox seen so far
+    std::atomic<std::uint64_t> coalesced{0};         // Positions replaced by a newer one
+    std::atomic<std::uint64_t> dropped_bulk{0};      // Bulk messages dropped (oldest first)
+    std::atomic<std::uint64_t> overflow_closes{0};   // Desktops closed because commands overflowed
+    std::atomic<std::uint64_t> parked_commands{0};   // Commands kept for a closed desktop's return
+    std::atomic<std::uint64_t> deferred_flushes{0};  // Flushes postponed by the high-water mark
+    std::atomic<std::uint64_t> batches{0};           // Batch messages sent to desktops
+    std::atomic<std::uint64_t> batched_frames{0};    // Frames that went out inside a batch
+};
+
+// A queued message together with the time the relay received it
+struct QueuedMessage {
+    message_ptr msg;
+    std::chrono::steady_clock::time_point received;
+};
+
+// Per-desktop outbound queue. Messages wait here instead of piling up inside
+// websocketpp, and are handed to the socket while its buffered amount stays
+// below the high-water mark. Guarded by its own mutex; see AirClassServer::enqueue.
+//
+// All classes share one FIFO, so a desktop receives messages in the order the
+// relay did; the class only decides what may be dropped. A newer position
+// removes the pending one and joins the tail, and bulk is dropped oldest first.
+struct DesktopOutbox {
+    // One queued message, stamped with its place in arrival order
+    struct Entry {
+        QueuedMessage queued;
+        MessageClass message_class;
+        std::uint64_t seq;
+    };
+
+    std::mutex lock;
+    std::deque<Entry> queue;            // Arrival order, seq ascending
+    std::deque<std::uint64_t> bulk;     // seq of every queued bulk message, oldest first
+    std::size_t commands = 0;           // Commands in queue, never dropped
+    bool has_position = false;          // A position is queued (at most one) ...
+    std::uint64_t position_seq = 0;     // ... with this seq
+    std::uint64_t next_seq = 0;         // seq of the next message queued
+    std::size_t bytes = 0;              // Payload bytes across the queue
+    std::size_t command_bytes = 0;      // The part of bytes held by commands
+    bool flush_scheduled = false;       // A retry timer is pending
+    bool batch = false;                 // Desktop accepts batched frames; set before it joins a room
+    bool overflowed = false;            // Being closed for too many commands; later ones are only kept
+
+    std::size_t depth() const { return queue.size(); }
+    // Positions and bulk: what may be dropped to make room
+    std::size_t droppable_depth() const { return queue.size() - commands; }
+    bool empty() const { return queue.empty(); }
+
+    // The message pop() would return next, or nullptr when nothing is queued
+    const QueuedMessage* peek() const {
+        return queue.empty() ? nullptr : &queue.front().queued;
+    }
+
+    // Appends a message; a position replaces the one still queued
+    void push(const QueuedMessage& queued, MessageClass message_class) {
+        if (message_class == MessageClass::POSITION) {
+            drop_position();
+            has_position = true;
+            position_seq = next_seq;
+        } else if (message_class == MessageClass::BULK) {
+            bulk.push_back(next_seq);
+        }
+        queue.push_back(Entry{queued, message_class, next_seq++});
+        count(queue.back(), 1);
+    }
+
+    // Oldest message, to hand to the socket. The queue must not be empty.
+    Entry pop() {
+        Entry next = std::move(queue.front());
+        queue.pop_front();
+        if (next.message_class == MessageClass::POSITION) {
+            has_position = false;
+        } else if (next.message_class == MessageClass::BULK) {
+            bulk.pop_front();
+        }
+        count(next, -1);
+        return next;
+    }
+
+    // Puts back an entry pop() returned, e.g. after a failed send. Entries
+    // must come back newest first.
+    void unpop(Entry entry) {
+        if (entry.message_class == MessageClass::POSITION) {
+            if (has_position) return;  // Only possible if a newer one was queued meanwhile
+            has_position = true;
+            position_seq = entry.seq;
+        } else if (entry.message_class == MessageClass::BULK) {
+            bulk.push_front(entry.seq);
+        }
+        count(entry, 1);
+        queue.push_front(std::move(entry));
+    }
+
+    // Removes the queued position. Returns false if there is none.
+    bool drop_position() {
+        if (!has_position) return false;
+        has_position = false;
+        erase(position_seq);
+        return true;
+    }
+
+    // Removes the oldest bulk message. Returns false if there is none.
+    bool drop_oldest_bulk() {
+        if (bulk.empty()) return false;
+        const std::uint64_t seq = bulk.front();
+        bulk.pop_front();
+        erase(seq);
+        return true;
+    }
+
+    // Queued commands, oldest first
+    std::deque<QueuedMessage> queued_commands() const {
+        std::deque<QueuedMessage> result;
+        for (auto const& entry : queue) {
+            if (entry.message_class == MessageClass::COMMAND) result.push_back(entry.queued);
+        }
+        return result;
+    }
+
+    void clear() {
+        queue.clear();
+        bulk.clear();
+        commands = 0;
+        has_position = false;
+        bytes = 0;
+        command_bytes = 0;
+    }
+
+    // Drops positions and bulk, keeping the commands
+    void clear_droppable() {
+        queue.erase(std::remove_if(queue.begin(), queue.end(), [](const Entry& entry) {
+            return entry.message_class != MessageClass::COMMAND;
+        }), queue.end());
+        bulk.clear();
+        has_position = false;
+        bytes = command_bytes;
+    }
+
+private:
+    void count(const Entry& entry, int sign) {
+        const std::size_t size = entry.queued.msg->get_payload().size();
+        bytes = sign > 0 ? bytes + size : bytes - size;
+        if (entry.message_class == MessageClass::COMMAND) {
+            commands = sign > 0 ? commands + 1 : commands - 1;
+            command_bytes = sign > 0 ? command_bytes + size : command_bytes - size;
+        }
+    }
+
+    // Removes the droppable entry with this seq (queue is sorted by seq)
+    void erase(std::uint64_t seq) {
+        auto it = std::lower_bound(queue.begin(), queue.end(), seq, [](const Entry& entry, std::uint64_t value) {
+            return entry.seq < value;
+        });
+        if (it == queue.end() || it->seq != seq) return;
+        count(*it, -1);
+        queue.erase(it);
+    }
+};
+
+// Counters and histograms served on /metrics. Everything is updated with
+// relaxed atomics from the worker threads; a scrape reads whatever is there.
+struct RelayMetrics {
+    static constexpr int kClientTypes = 3;  // Indexed by ClientType
+
+    std::atomic<std::uint64_t> messages_in[kClientTypes] = {};   // Received, by sender type
+    std::atomic<std::uint64_t> messages_out[kClientTypes] = {};  // Sent, by receiver type
+    std::atomic<std::uint64_t> registration_failures{0};
+    std::atomic<std::uint64_t> http_requests{0};
+    airclass::metrics::LogLinearHistogram forward_latency_us;    // on_message -> send, per desktop
+    airclass::metrics::LogLinearHistogram queue_depth;           // Outbox depth after each enqueue
+};
+
+// Rate limiter for one hardware client's position stream. The first position
+// after a quiet period goes out at once; later ones inside the same tick only
+// replace the pending sample, which a timer forwards at the end of the tick.
+struct PositionThrottle {
+    std::mutex lock;
+    QueuedMessage pending;                                // Newest unsent position
+    std::chrono::steady_clock::time_point next_send{};    // Start of the next tick
+    bool timer_armed = false;                             // Trailing flush scheduled
+};
+
+// One fan-out target in the desktop subscriber snapshot
+struct DesktopEntry {
+    connection_hdl hdl;                       // Desktop connection handle
+    std::string id;                           // Client ID, for logs
+    int binary = 0;                           // Negotiated binary frame version (0 = JSON only)
+    std::shared_ptr<DesktopOutbox> outbox;    // Mutable queue; the entry itself is not
+};
+
+// Copy-on-write table: writers build a new instance and publish it with
+// std::atomic_store, readers grab the current one with std::atomic_load.
+typedef std::vector<DesktopEntry> DesktopList;
+// Room name -> desktops subscribed to that room. Only rooms with at least one
+// desktop are present; a writer replaces just the list of the room it touches.
+typedef std::unordered_map<std::string, std::shared_ptr<const DesktopList>> RoomIndex;
+
+// Reads a positive size from the environment, keeping the default when unset or invalid
+inline std::size_t envSize(const char* name, std::size_t fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr) return fallback;
+    try {
+        long long parsed = std::stoll(value);
+        if (parsed > 0) return static_cast<std::size_t>(parsed);
+    } catch (...) {
+    }
+    AC_LOG(Warn) << "Invalid " << name << " env var, using default " << fallback << ".";
+    return fallback;
+}
+
+// Finds desktops on the LAN by UDP broadcast without holding up the relay.
+// Broadcasts "raspberry_discovery" to the discovery port; every desktop running
+// UdpDiscoveryServer answers with its own IPv4 address. Announces every
+// FAST_INTERVAL_MS for the first FAST_ANNOUNCEMENTS rounds, then keeps
+// re-announcing at the configured interval so desktops started later are found
+// too. All socket work runs on the relay's io_service, serialized by a strand;
+// replies update a peer table that /metrics reads.
+class DesktopDiscovery {
+public:
+    typedef websocketpp::lib::asio::ip::udp udp;
+
+    struct Peer {
+        std::string ip;
+        std::chrono::steady_clock::time_point first_seen;
+        std::chrono::steady_clock::time_point last_seen;
+        std::uint64_t replies = 0;
+    };
+
+    DesktopDiscovery(websocketpp::lib::asio::io_service& io, unsigned short port, std::chrono::seconds interval,
+                     std::string message = "raspberry_discovery")
+        : m_strand(io)
+        , m_socket(io)
+        , m_timer(io)
+        , m_broadcast(websocketpp::lib::asio::ip::address_v4::broadcast(), port)
+        , m_interval(interval)
+        , m_message(std::move(message))
+    {}
+
+    // Opens the socket and starts announcing; returns immediately
+    bool start() {
+        websocketpp::lib::asio::error_code ec;
+        m_socket.open(udp::v4(), ec);
+        if (!ec) m_socket.set_option(websocketpp::lib::asio::socket_base::broadcast(true), ec);
+        if (ec) {
+            AC_LOG(Error) << "[UDP] Discovery socket: " << ec.message();
+            return false;
+        }
+        AC_LOG(Info) << "[UDP] Starting desktop discovery on port " << m_broadcast.port()
+                     << ", re-announcing every " << m_interval.count() << "s";
+        m_strand.dispatch([this]() {
+            receive();
+            announce();
+        });
+        return true;
+    }
+
+    void stop() {
+        if (m_stopped.exchange(true)) return;
+        m_strand.dispatch([this]() {
+            websocketpp::lib::asio::error_code ec;
+            m_timer.cancel(ec);
+            m_socket.close(ec);
+        });
+    }
+
+    // Desktops that answered within the last three announcement intervals
+    std::vector<Peer> peers() const {
+        std::lock_guard<std::mutex> guard(m_peer_lock);
+        std::vector<Peer> result;
+        result.reserve(m_peers.size());
+        for (auto const& entry : m_peers) result.push_back(entry.second);
+        return result;
+    }
+
+    std::uint64_t announcements() const { return m_announcements.load(std::memory_order_relaxed); }
+
+private:
+    void announce() {
+        if (m_stopped) return;
+        expire_peers();
+        m_socket.async_send_to(websocketpp::lib::asio::buffer(m_message), m_broadcast,
+            m_strand.wrap([this](const websocketpp::lib::asio::error_code& ec, std::size_t) {
+                if (ec == websocketpp::lib::asio::error::operation_aborted) return;
+                if (ec) {
+                    AC_LOG_RATE(Error, 1) << "[UDP] sendto: " << ec.message();
+                } else {
+                    AC_LOG(Debug) << "[UDP] Broadcast sent (announcement " << announcements() << ")";
+                }
+            }));
+        const auto round = m_announcements.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        m_timer.expires_after(round < FAST_ANNOUNCEMENTS ? std::chrono::milliseconds(FAST_INTERVAL_MS)
+                                                         : std::chrono::milliseconds(m_interval));
+        m_timer.async_wait(m_strand.wrap([this](const websocketpp::lib::asio::error_code& ec) {
+            if (!ec) announce();
+        }));
+    }
+
+    void receive() {
+        if (m_stopped) return;
+        m_socket.async_receive_from(websocketpp::lib::asio::buffer(m_buffer), m_sender,
+            m_strand.wrap([this](const websocketpp::lib::asio::error_code& ec, std::size_t length) {
+                if (ec == websocketpp::lib::asio::error::operation_aborted || m_stopped) return;
+                if (ec) {
+                    AC_LOG_RATE(Error, 1) << "[UDP] recvfrom: " << ec.message();
+                } else {
+                    on_reply(std::string(m_buffer.data(), length));
+                }
+                receive();
+            }));
+    }
+
+    void on_reply(std::string reply) {
+        while (!reply.empty() && std::isspace(static_cast<unsigned char>(reply.back()))) reply.pop_back();
+        websocketpp::lib::asio::error_code ec;
+        websocketpp::lib::asio::ip::make_address_v4(reply, ec);
+        if (ec) {
+            AC_LOG_RATE(Error, 1) << "[UDP] Invalid IP response received from "
+                                  << m_sender.address().to_string() << ": '" << reply << "'";
+            return;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> guard(m_peer_lock);
+        auto inserted = m_peers.emplace(reply, Peer());
+        Peer& peer = inserted.first->second;
+        if (inserted.second) {
+            peer.ip = reply;
+            peer.first_seen = now;
+            AC_LOG(Info) << "[UDP] Desktop IP address found: " << reply;
+        }
+        peer.last_seen = now;
+        peer.replies++;
+    }
+
+    // Forgets desktops that stopped answering
+    void expire_peers() {
+        const auto cutoff = std::chrono::steady_clock::now() - 3 * m_interval;
+        std::lock_guard<std::mutex> guard(m_peer_lock);
+        for (auto it = m_peers.begin(); it != m_peers.end();) {
+            if (it->second.last_seen < cutoff) {
+                AC_LOG(Info) << "[UDP] Desktop at " << it->first << " stopped answering discovery";
+                it = m_peers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    websocketpp::lib::asio::io_service::strand m_strand;  // Serializes socket and timer handlers
+    udp::socket m_socket;
+    websocketpp::lib::asio::steady_timer m_timer;          // Next announcement
+    udp::endpoint m_broadcast;                             // 255.255.255.255:port
+    udp::endpoint m_sender;                                // Source of the reply being received
+    std::array<char, 128> m_buffer{};
+    const std::chrono::seconds m_interval;                 // Steady-state announcement interval
+    const std::string m_message;
+    std::atomic<bool> m_stopped{false};
+    std::atomic<std::uint64_t> m_announcements{0};
+    mutable std::mutex m_peer_lock;                        // Guards m_peers (strand writes, /metrics reads)
+    std::map<std::string, Peer> m_peers;                   // Keyed by desktop IP
+
+    static constexpr int FAST_ANNOUNCEMENTS = 5;       // Startup rounds at the fast interval
+    static constexpr long FAST_INTERVAL_MS = 2000;     // Startup announcement interval
+};
+
+class AirClassServer {
+public:
+    AirClassServer() {
+        // Configure WebSocket++ logging: only show connect/disconnect/app logs
+        m_server.clear_access_channels(websocketpp::log::alevel::all);
+        m_server.set_access_channels(websocketpp::log::alevel::connect);
+        m_server.set_access_channels(websocketpp::log::alevel::disconnect);
+        m_server.set_access_channels(websocketpp::log::alevel::app);
+
+        // Initialize ASIO subsystem
+        m_server.init_asio();
+
+        // Start with an empty published snapshot
+        m_rooms = std::make_shared<const RoomIndex>();
+
+        // Per-desktop queue caps
+        m_outbox_limits.max_messages = envSize("AIRCLASS_OUTBOX_MESSAGES", m_outbox_limits.max_messages);
+        m_outbox_limits.max_bytes = envSize("AIRCLASS_OUTBOX_BYTES", m_outbox_limits.max_bytes);
+        m_outbox_limits.socket_high_water = envSize("AIRCLASS_OUTBOX_HIGH_WATER", m_outbox_limits.socket_high_water);
+        m_outbox_limits.max_commands = envSize("AIRCLASS_OUTBOX_COMMANDS", m_outbox_limits.max_commands);
+
+        // Frames queued within this window of each other go out as one batch
+        // message to desktops that registered with "batch": true
+        m_batch_window = std::chrono::microseconds(envSize("AIRCLASS_BATCH_WINDOW_US", 1000));
+        // Outgoing messages at least this large are deflated for peers that
+        // negotiated permessage-deflate (builds with AIRCLASS_DEFLATE only)
+        m_deflate_min_bytes = envSize("AIRCLASS_DEFLATE_MIN_BYTES", airclass::kDefaultDeflateMinBytes);
+
+        // Position updates per second forwarded for each hardware client
+        m_position_hz = envSize("AIRCLASS_POSITION_HZ", m_position_hz);
+        m_position_period = std::chrono::microseconds(1000000 / m_position_hz);
+
+        // Commands older than this are not replayed (the log is opened by listen())
+        m_replay_max_age_ms = static_cast<std::int64_t>(envSize("AIRCLASS_REPLAY_MAX_AGE", 900)) * 1000;
+
+        // Register callback handlers for lifecycle events. Message and close
+        // handlers are set per connection in on_open, bound to its ClientSlot.
+        m_server.set_open_handler(bind(&AirClassServer::on_open, this, _1));
+        // Plain HTTP requests on the same port: GET /metrics
+        m_server.set_http_handler(bind(&AirClassServer::on_http, this, _1));
+    }
+
+    // Starts listening on the given port and runs the ASIO loop on a pool of worker threads
+    void run(uint16_t port, std::size_t thread_count = 1) {
+        if (!listen(port)) return;
+
+        // All workers share one io_service. WebSocket++ wraps every connection's
+        // handlers in its own strand, so callbacks for a single client stay ordered
+        // while different clients are serviced in parallel.
+        if (thread_count == 0) thread_count = 1;
+        AC_LOG(Info) << "Running event loop on " << thread_count << " worker thread(s)";
+
+        std::vector<std::thread> workers;
+        workers.reserve(thread_count - 1);
+        for (std::size_t i = 1; i < thread_count; ++i) {
+            workers.emplace_back(&AirClassServer::run_worker, this);
+        }
+        run_worker();                     // The calling thread is worker #0 (blocks)
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Same as run(), but every worker is a background thread and this returns
+    // once the relay is listening. Used by the embedded relay; stop() joins
+    // the workers. Returns false if the port cannot be opened.
+    bool start(uint16_t port, std::size_t thread_count = 1) {
+        if (!listen(port)) return false;
+        if (thread_count == 0) thread_count = 1;
+        AC_LOG(Info) << "Running event loop on " << thread_count << " background thread(s)";
+        for (std::size_t i = 0; i < thread_count; ++i) {
+            m_workers.emplace_back(&AirClassServer::run_worker, this);
+        }
+        return true;
+    }
+
+    // Registers a gesture producer in this process (the hardware client of an
+    // embedded relay). It counts as a hardware client but has no connection:
+    // its gestures come in through publish_local().
+    ClientInfo register_local(const std::string& client_id, const std::string& room) {
+        ClientInfo producer;
+        producer.id = client_id;
+        producer.room = room.empty() ? DEFAULT_ROOM : room;
+        producer.binary = airclass::kFrameVersion;
+        producer.throttle = std::make_shared<PositionThrottle>();
+        m_client_counts[static_cast<int>(ClientType::HARDWARE)].fetch_add(1, std::memory_order_relaxed);
+        AC_LOG(Info) << "Local hardware registered: ID=" << producer.id << ", Room=" << producer.room;
+        return producer;
+    }
+
+    // Hands a gesture of a local producer to the fan-out, exactly as if its
+    // binary frame had arrived over a hardware connection, minus the socket.
+    // Call from one thread per producer (a connection's handlers are
+    // serialized the same way).
+    void publish_local(const ClientInfo& producer, const airclass::GestureFrame& frame) {
+        const auto received = std::chrono::steady_clock::now();
+        char buffer[airclass::kMaxFrameSize];
+        const std::string payload(buffer, airclass::encodeFrame(frame, buffer));
+        message_ptr msg = make_message(payload, websocketpp::frame::opcode::binary);
+        m_metrics.messages_in[static_cast<int>(ClientType::HARDWARE)].fetch_add(1, std::memory_order_relaxed);
+        if (airclass::logging::enabled(airclass::logging::Level::Debug)) {
+            log_hardware_message(producer, msg);
+        }
+        route_hardware_message(producer, QueuedMessage{msg, received}, binary_class(frame));
+    }
+
+    // Gracefully shuts down all connections and stops the server loop
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(m_connection_lock);
+
+            // Close each open connection with a "going_away" status
+            m_clients.for_each_in_use([this](ClientSlot& slot) {
+                try {
+                    if (!slot.hdl.expired()) {
+                        m_server.close(slot.hdl, websocketpp::close::status::going_away, "Server shutdown");
+                    }
+                } catch (const websocketpp::exception& e) {
+                    AC_LOG(Error) << "Exception closing connection: " << e.what();
+                }
+            });
+            publish_rooms(std::make_shared<const RoomIndex>());
+
+            if (m_discovery) m_discovery->stop();
+
+            // Stop accepting new connections and exit the ASIO loop
+            m_server.stop_listening();
+            m_server.stop();
+        }
+        // Background workers from start(); close handlers need the lock above
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+        m_workers.clear();
+        AC_LOG(Info) << "WebSocket Server stopped.";
+    }
+
+private:
+    // Opens the replay log and the listening socket, and starts the desktop announcer
+    bool listen(uint16_t port) {
+        open_replay(port);
+        try {
+            m_server.listen(port);        // Bind socket to port
+            m_server.start_accept();      // Begin accepting connections
+            AC_LOG(Info) << "WebSocket Server started on port " << port;
+            AC_LOG(Info) << "Desktop outbox: " << m_outbox_limits.max_commands << " commands, "
+                         << m_outbox_limits.max_messages << " messages / "
+                         << m_outbox_limits.max_bytes << " bytes, socket high-water "
+                         << m_outbox_limits.socket_high_water << " bytes";
+            AC_LOG(Info) << "Position updates limited to " << m_position_hz << " Hz per hardware client";
+            AC_LOG(Info) << "Batch window " << m_batch_window.count() << " us; permessage-deflate "
+                         << (airclass::kDeflateAvailable
+                                 ? "for messages of at least " + std::to_string(m_deflate_min_bytes) + " bytes"
+                                 : std::string("not built in"));
+            schedule_outbox_report();
+
+            // Announce to desktops in the background; connections are served meanwhile
+            m_discovery.reset(new DesktopDiscovery(
+                m_server.get_io_service(),
+                static_cast<unsigned short>(envSize("AIRCLASS_DISCOVERY_PORT", 9999)),
+                std::chrono::seconds(envSize("AIRCLASS_DISCOVERY_INTERVAL", 30))));
+            m_discovery->start();
+        } catch (const websocketpp::exception& e) {
+            AC_LOG(Error) << "WebSocket Exception: " << e.what();
+            return false;
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Standard Exception during run: " << e.what();
+            return false;
+        }
+        return true;
+    }
+
+    // Opens the replay log of recent commands. AIRCLASS_REPLAY_FILE names it
+    // ("off" disables it); by default each port gets its own file in a
+    // directory only this user writes to. Replay stays off if the file is
+    // already in use by another relay.
+    void open_replay(uint16_t port) {
+        const char* replay_file = std::getenv("AIRCLASS_REPLAY_FILE");
+        std::string replay_path;
+        if (replay_file) {
+            replay_path = replay_file;
+        } else {
+            const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+            const std::string dir = runtime_dir && *runtime_dir ? runtime_dir : "/var/lib/airclass";
+            if (!runtime_dir || !*runtime_dir) mkdir(dir.c_str(), 0700);  // May already exist
+            replay_path = dir + "/airclass-replay-" + std::to_string(port) + ".log";
+        }
+        if (replay_path == "off") return;
+        const std::size_t slots = envSize("AIRCLASS_REPLAY_SLOTS", 4096);
+        if (m_replay.open(replay_path, slots)) {
+            AC_LOG(Info) << "Replay log " << replay_path << ": " << slots << " events, head rseq "
+                         << m_replay.head();
+        } else if (errno == EWOULDBLOCK) {
+            AC_LOG(Error) << "Replay log " << replay_path << " is in use by another relay"
+                          << "; reconnecting desktops will not catch up";
+        } else {
+            AC_LOG(Error) << "Cannot open replay log " << replay_path << ": " << std::strerror(errno)
+                          << "; reconnecting desktops will not catch up";
+        }
+    }
+
+    // Body of each worker thread: service the shared event loop until stop()
+    void run_worker() {
+        try {
+            m_server.run();
+        } catch (const websocketpp::exception& e) {
+            AC_LOG(Error) << "WebSocket Exception in worker: " << e.what();
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Standard Exception in worker: " << e.what();
+        }
+    }
+
+    // Handler: new client connection opened. Takes a ClientSlot and binds its
+    // index into this connection's message and close handlers.
+    void on_open(connection_hdl hdl) {
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        const std::uint32_t slot = m_clients.acquire(hdl);
+        if (slot == ClientSlab::kNoSlot) {
+            AC_LOG_RATE(Error, 1) << "Connection limit reached, refusing connection";
+            websocketpp::lib::error_code ec;
+            m_server.close(hdl, websocketpp::close::status::try_again_later, "Server full", ec);
+            return;
+        }
+        con->set_message_handler(bind(&AirClassServer::on_message, this, slot, _1, _2));
+        con->set_close_handler(bind(&AirClassServer::on_close, this, slot, _1));
+        m_client_counts[static_cast<int>(ClientType::UNKNOWN)].fetch_add(1, std::memory_order_relaxed);
+        AC_LOG(Info) << "Connection opened. Awaiting registration.";
+    }
+
+    // Handler: client connection closed
+    void on_close(std::uint32_t slot_index, connection_hdl hdl) {
+        ClientSlot& slot = m_clients[slot_index];
+        const ClientType type = slot.type.load(std::memory_order_relaxed);
+        // Log the disconnected client's type and ID
+        AC_LOG(Info) << "Client disconnected: Type="
+                  << clientTypeToString(type)
+                  << ", ID=" << (slot.info.id.empty() ? "[unregistered]" : slot.info.id);
+        if (type == ClientType::DESKTOP) {
+            std::lock_guard<std::mutex> guard(m_connection_lock);
+            remove_desktop(slot.info.room, hdl);
+        }
+        m_client_counts[static_cast<int>(type)].fetch_sub(1, std::memory_order_relaxed);
+        m_clients.release(slot_index);
+    }
+
+    // Handler: plain HTTP request (not a WebSocket upgrade). Serves the metrics
+    // in Prometheus text format; everything else is a 404.
+    void on_http(connection_hdl hdl) {
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        m_metrics.http_requests.fetch_add(1, std::memory_order_relaxed);
+        if (con->get_resource() == "/metrics") {
+            con->set_status(websocketpp::http::status_code::ok);
+            con->append_header("Content-Type", "text/plain; version=0.0.4");
+            con->set_body(render_metrics());
+        } else {
+            con->set_status(websocketpp::http::status_code::not_found);
+            con->append_header("Content-Type", "text/plain");
+            con->set_body("Not found\n");
+        }
+    }
+
+    // Handler: message received from a client
+    void on_message(std::uint32_t slot_index, connection_hdl hdl, message_ptr msg) {
+        const auto received = std::chrono::steady_clock::now();  // Start of relay latency
+        const std::string& payload = msg->get_payload();  // Raw message, not copied
+
+        // Sender metadata lives in the slot bound to this connection
+        ClientSlot& slot = m_clients[slot_index];
+        const ClientType sender_type = slot.type.load(std::memory_order_relaxed);
+        const ClientInfo* sender_info = &slot.info;
+        m_metrics.messages_in[static_cast<int>(sender_type)].fetch_add(1, std::memory_order_relaxed);
+
+        // 1) If not yet registered, handle registration flow
+        if (sender_type == ClientType::UNKNOWN) {
+            handle_registration(slot, hdl, payload);
+            return;
+        }
+
+        // 2) For hardware clients, log a one-line summary when debugging. The
+        //    frame is only parsed for that summary; routing uses the sender's room.
+        if (sender_type == ClientType::HARDWARE) {
+            mark_compressible(*msg);  // Not shared with any desktop yet
+            if (airclass::logging::enabled(airclass::logging::Level::Debug)) {
+                log_hardware_message(*sender_info, msg);
+            }
+
+            MessageClass message_class;
+            if (!classify_message(msg, message_class)) {
+                AC_LOG_RATE(Warn, 5) << "Dropping malformed binary frame from " << sender_info->id
+                                     << " (" << payload.size() << " bytes)";
+                return;
+            }
+
+            route_hardware_message(*sender_info, QueuedMessage{msg, received}, message_class);
+        } 
+        else if (sender_type == ClientType::DESKTOP) {
+            // For desktop clients, just log receipt
+            AC_LOG(Debug) << "Message from desktop client (ID: " << sender_info->id
+                          << ") received but not forwarded.";
+        }
+    }
+
+    // Forwards a hardware message itself to the desktops of the sender's room.
+    // Positions are thinned to the configured rate first; a command flushes
+    // any pending position so the desktop sees them in order.
+    void route_hardware_message(const ClientInfo& sender, QueuedMessage queued, MessageClass message_class) {
+        if (message_class == MessageClass::POSITION) {
+            throttle_position(sender, std::move(queued));
+        } else {
+            flush_position(sender);
+            forward_message_to_desktops(sender.room, queued, message_class);
+        }
+    }
+
+    // Parses and validates client registration messages
+    void handle_registration(ClientSlot& slot, connection_hdl hdl, const std::string& payload) {
+        try {
+            json data = json::parse(payload);
+
+            // Check required fields
+            if (!data.contains("register") || !data.contains("id")) {
+                reject_registration(hdl, "Registration requires 'register' and 'id'.");
+                return;
+            }
+
+            const std::string& type_str = data["register"].get_ref<const std::string&>();
+            std::string client_id = data["id"];
+            if (client_id.empty()) {
+                reject_registration(hdl, "Client ID cannot be empty.");
+                return;
+            }
+
+            // Optional room; older clients without one share the default room
+            std::string room = data.value("room", "");
+            if (room.empty()) room = DEFAULT_ROOM;
+
+            // Optional binary frame support; we speak at most our own version
+            int binary = std::clamp(data.value("binary", 0), 0, static_cast<int>(airclass::kFrameVersion));
+            // Optional batching of frames that are queued together; needs binary frames
+            const bool batch = binary > 0 && data.value("batch", false);
+
+            // Optional newest relay sequence a reconnecting desktop has already
+            // seen, with the epoch of the replay log it came from
+            bool wants_replay = data.contains("last_seq") && data["last_seq"].is_number_unsigned();
+            const std::uint64_t last_seq = wants_replay ? data["last_seq"].get<std::uint64_t>() : 0;
+            const std::string last_epoch = data.value("epoch", "");
+
+            // Map string to enum - simplified to only care about hardware and desktop
+            const ClientType new_type = clientTypeFromString(type_str);
+            if (new_type == ClientType::UNKNOWN) {
+                reject_registration(hdl, "Invalid client type: " + type_str + ". Must be 'hardware' or 'desktop'.");
+                return;
+            }
+
+            // Fill in the slot, then switch its role; only this connection's
+            // handlers read the slot's registration data
+            ClientInfo& client_info = slot.info;
+            client_info.id = client_id;
+            client_info.room = room;
+            client_info.binary = binary;
+            if (new_type == ClientType::HARDWARE) {
+                client_info.throttle = std::make_shared<PositionThrottle>();
+            }
+            json confirmation = {
+                {"type", "registration_success"},
+                {"client_type", clientTypeToString(new_type)},
+                {"client_id", client_id},
+                {"room", room},
+                {"binary", binary}
+            };
+            if (new_type == ClientType::DESKTOP) {
+                confirmation["batch"] = batch;
+            }
+            std::size_t replayed = 0;
+            slot.type.store(new_type, std::memory_order_relaxed);
+            m_client_counts[static_cast<int>(ClientType::UNKNOWN)].fetch_sub(1, std::memory_order_relaxed);
+            m_client_counts[static_cast<int>(new_type)].fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> guard(m_connection_lock);
+                if (new_type == ClientType::DESKTOP) {
+                    // Confirmation, then the missed commands, then live traffic:
+                    // the desktop joins its room only after the replay is queued,
+                    // and no command is sequenced in between.
+                    DesktopEntry entry{hdl, client_id, binary, std::make_shared<DesktopOutbox>()};
+                    entry.outbox->batch = batch;
+                    std::lock_guard<std::mutex> replay_guard(m_replay_lock);
+                    std::vector<message_ptr> backlog;
+                    if (m_replay.isOpen()) {
+                        const std::string epoch = epoch_string(m_replay.epoch());
+                        confirmation["rseq"] = m_replay.head();
+                        confirmation["epoch"] = epoch;
+                        // An rseq of another relay or an older log means nothing here
+                        if (wants_replay && !last_epoch.empty() && last_epoch != epoch) {
+                            AC_LOG(Info) << "Desktop " << client_id << " last saw another replay log; not replaying";
+                            wants_replay = false;
+                        }
+                        if (wants_replay) {
+                            confirmation["replay_truncated"] = collect_replay(room, last_seq, binary, backlog);
+                            confirmation["replayed"] = backlog.size();
+                        }
+                    }
+                    // Commands queued for this desktop when its last connection
+                    // closed; the replay above already covers them when used
+                    std::vector<message_ptr> parked = take_parked(room, client_id, binary);
+                    if (!(wants_replay && m_replay.isOpen())) {
+                        backlog = std::move(parked);
+                    }
+                    m_server.send(hdl, confirmation.dump(), websocketpp::frame::opcode::text);
+                    for (auto const& msg : backlog) {
+                        enqueue(entry, QueuedMessage{msg, std::chrono::steady_clock::now()}, MessageClass::COMMAND);
+                    }
+                    replayed = backlog.size();
+                    add_desktop(room, std::move(entry));
+                } else {
+                    m_server.send(hdl, confirmation.dump(), websocketpp::frame::opcode::text);
+                }
+            }
+            m_metrics.messages_out[static_cast<int>(new_type)].fetch_add(1, std::memory_order_relaxed);
+            m_replayed_total.fetch_add(replayed, std::memory_order_relaxed);
+            AC_LOG(Info) << "Client registered: Type=" 
+                      << clientTypeToString(new_type)
+                      << ", ID=" << client_id
+                      << ", Room=" << room
+                      << ", Frames=" << (binary ? (batch ? "binary, batched" : "binary") : "JSON");
+            if (wants_replay) {
+                AC_LOG(Info) << "Replayed " << replayed << " command(s) after rseq " << last_seq << " to " << client_id;
+            }
+
+        } catch (const json::parse_error& e) {
+            reject_registration(hdl, "Invalid JSON for registration.");
+        } catch (const std::exception& e) {
+            AC_LOG(Error) << "Registration error: " << e.what();
+            reject_registration(hdl, "Internal server error.");
+        }
+    }
+
+    // Counts a failed registration and tells the client why
+    void reject_registration(connection_hdl hdl, const std::string& reason) {
+        m_metrics.registration_failures.fetch_add(1, std::memory_order_relaxed);
+        send_error(hdl, reason);
+    }
+
+    // Broadcasts a received message to the desktop clients of one room. Works on
+    // the current room snapshot, so it never waits for connections opening or
+    // closing, and costs O(desktops in that room). The incoming message_ptr is
+    // handed to every desktop as-is: no payload copy and no re-parse here.
+    // Binary gesture frames are the exception for desktops that registered
+    // without binary support: they get a JSON rendering, built once per frame.
+    void forward_message_to_desktops(const std::string& room, const QueuedMessage& received, MessageClass message_class) {
+        // Traced messages get the relay's dwell time written into a copy
+        QueuedMessage queued = is_traced(*received.msg) ? stamp_relay_dwell(received) : received;
+
+        // Commands are logged for reconnecting desktops, even when nobody is in
+        // the room right now. Logging and loading the room list happen under one
+        // lock, so a desktop registering concurrently gets each command exactly
+        // once: either replayed or live.
+        std::shared_ptr<const RoomIndex> rooms;
+        if (message_class == MessageClass::COMMAND && m_replay.isOpen()) {
+            std::lock_guard<std::mutex> replay_guard(m_replay_lock);
+            queued = sequence_message(room, queued);
+            rooms = std::atomic_load(&m_rooms);
+        } else {
+            rooms = std::atomic_load(&m_rooms);
+        }
+
+        auto room_it = rooms->find(room);
+        if (room_it == rooms->end()) {
+            AC_LOG_RATE(Info, 1) << "No desktop clients in room '" << room << "' to forward message to";
+            return;
+        }
+        const message_ptr& msg = queued.msg;
+        const DesktopList& desktops = *room_it->second;
+        const bool is_binary = msg->get_opcode() == websocketpp::frame::opcode::binary;
+        message_ptr json_fallback;  // Built on the first JSON-only desktop
+        int queued_count = 0;
+
+        for (auto const& desktop : desktops) {
+            if (desktop.hdl.expired()) continue;
+            if (is_binary && desktop.binary == 0) {
+                if (!json_fallback) {
+                    airclass::GestureFrame frame;
+                    airclass::decodeFrame(msg->get_payload().data(), msg->get_payload().size(), frame);
+                    json_fallback = make_message(frame_to_json(frame), websocketpp::frame::opcode::text);
+                }
+                enqueue(desktop, QueuedMessage{json_fallback, queued.received}, message_class);
+            } else {
+                enqueue(desktop, queued, message_class);
+            }
+            queued_count++;
+        }
+        
+        AC_LOG(Debug) << "Queued message for " << queued_count
+                      << " desktop client(s) in room '" << room << "'";
+    }
+
+    // Adds a message to one desktop's outbox according to its class, then tries
+    // to flush. Positions and bulk make room for each other; commands are
+    // never dropped. A desktop with more than max_commands commands waiting is
+    // hopelessly behind: it is disconnected, and its queued commands are kept
+    // for it (see remove_desktop) until it reconnects under the same ID.
+    void enqueue(const DesktopEntry& desktop, const QueuedMessage& queued, MessageClass message_class) {
+        DesktopOutbox& outbox = *desktop.outbox;
+        bool overflow = false;
+        bool closing = false;
+        {
+            std::lock_guard<std::mutex> guard(outbox.lock);
+            const std::size_t depth_before = outbox.depth();
+            const std::size_t bytes_before = outbox.bytes;
+
+            if (message_class == MessageClass::POSITION && outbox.has_position) {
+                m_outbox_metrics.coalesced.fetch_add(1, std::memory_order_relaxed);
+            }
+            outbox.push(queued, message_class);
+            m_metrics.queue_depth.record(outbox.depth());
+
+            // Make room: bulk goes first, then the pending position
+            while (over_limits(outbox) && outbox.drop_oldest_bulk()) {
+                m_outbox_metrics.dropped_bulk.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (over_limits(outbox) && outbox.drop_position()) {
+                m_outbox_metrics.coalesced.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (outbox.commands > m_outbox_limits.max_commands) {
+                overflow = !outbox.overflowed;
+                outbox.overflowed = true;
+                outbox.clear_droppable();
+            }
+            closing = outbox.overflowed;
+
+            account(depth_before, bytes_before, outbox);
+        }
+
+        if (overflow) {
+            m_outbox_metrics.overflow_closes.fetch_add(1, std::memory_order_relaxed);
+            AC_LOG_RATE(Warn, 1) << "Outbox overflow for desktop ID " << desktop.id
+                                 << ", closing connection";
+            websocketpp::lib::error_code ec;
+            m_server.close(desktop.hdl, websocketpp::close::status::try_again_later, "Send queue overflow", ec);
+        }
+        if (closing) return;
+        flush_outbox(desktop.hdl, desktop.outbox);
+    }
+
+    // Hands queued messages to websocketpp while the connection's own send
+    // buffer stays below the high-water mark. If it is above, a short timer
+    // retries later; the outbox keeps enforcing its caps in the meantime.
+    void flush_outbox(connection_hdl hdl, const std::shared_ptr<DesktopOutbox>& outbox) {
+        std::lock_guard<std::mutex> guard(outbox->lock);
+        if (outbox->empty()) return;
+
+        websocketpp::lib::error_code ec;
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+        const std::size_t depth_before = outbox->depth();
+        const std::size_t bytes_before = outbox->bytes;
+        if (ec || !con) {
+            // Connection is gone; on_close removes the entry and keeps the commands
+            outbox->clear_droppable();
+            account(depth_before, bytes_before, *outbox);
+            return;
+        }
+
+        std::vector<DesktopOutbox::Entry> taken;  // What the next send carries
+        while (!outbox->empty() && con->get_buffered_amount() < m_outbox_limits.socket_high_water) {
+            taken.clear();
+            taken.push_back(outbox->pop());
+            message_ptr msg = taken.front().queued.msg;
+            if (outbox->batch && is_batchable(*msg) && is_batchable_after(*outbox, taken.front().queued)) {
+                msg = build_batch(*outbox, taken);
+            }
+            m_server.send(hdl, msg, ec);
+            if (ec) {
+                // Back to the front in the same order, so no command is lost;
+                // the retry timer below tries again
+                for (auto it = taken.rbegin(); it != taken.rend(); ++it) outbox->unpop(std::move(*it));
+                AC_LOG_RATE(Warn, 5) << "Send error to desktop: " << ec.message();
+                break;
+            }
+            for (auto const& entry : taken) record_forwarded(entry.queued.received);
+            if (taken.size() > 1) {
+                m_outbox_metrics.batches.fetch_add(1, std::memory_order_relaxed);
+                m_outbox_metrics.batched_frames.fetch_add(taken.size(), std::memory_order_relaxed);
+            }
+        }
+        account(depth_before, bytes_before, *outbox);
+
+        if (!outbox->empty() && !outbox->flush_scheduled) {
+            outbox->flush_scheduled = true;
+            m_outbox_metrics.deferred_flushes.fetch_add(1, std::memory_order_relaxed);
+            std::weak_ptr<DesktopOutbox> weak_outbox = outbox;
+            m_server.set_timer(OUTBOX_RETRY_MS, [this, hdl, weak_outbox](websocketpp::lib::error_code const& timer_ec) {
+                auto pending = weak_outbox.lock();
+                if (timer_ec || !pending) return;
+                {
+                    std::lock_guard<std::mutex> retry_guard(pending->lock);
+                    pending->flush_scheduled = false;
+                }
+                flush_outbox(hdl, pending);
+            });
+        }
+    }
+
+    // A single binary gesture frame (not already a batch)
+    static bool is_batchable(const server::message_type& msg) {
+        const std::string& payload = msg.get_payload();
+        return msg.get_opcode() == websocketpp::frame::opcode::binary &&
+               payload.size() >= airclass::kFrameSize && payload.size() <= airclass::kMaxFrameSize &&
+               !airclass::isBatch(payload.data(), payload.size());
+    }
+
+    // Whether the outbox's next message can share a batch with first
+    bool is_batchable_after(const DesktopOutbox& outbox, const QueuedMessage& first) const {
+        const QueuedMessage* next = outbox.peek();
+        return next != nullptr && is_batchable(*next->msg) &&
+               next->received - first.received <= m_batch_window;
+    }
+
+    // Packs the frame in taken and the frames queued right behind it (received
+    // within the batch window of the first) into one binary message. Nothing
+    // waits for more frames to arrive: only what is already queued is batched.
+    // Appends every packed entry to taken. Caller holds the outbox lock.
+    message_ptr build_batch(DesktopOutbox& outbox, std::vector<DesktopOutbox::Entry>& taken) {
+        const QueuedMessage& first = taken.front().queued;
+        std::string payload;
+        payload.reserve(2 + 4 * (1 + airclass::kMaxFrameSize));
+        airclass::beginBatch(payload);
+        airclass::appendToBatch(payload, first.msg->get_payload().data(), first.msg->get_payload().size());
+        while (taken.size() < airclass::kMaxBatchFrames && is_batchable_after(outbox, taken.front().queued)) {
+            taken.push_back(outbox.pop());
+            const std::string& frame = taken.back().queued.msg->get_payload();
+            airclass::appendToBatch(payload, frame.data(), frame.size());
+        }
+        return make_message(payload, websocketpp::frame::opcode::binary);
+    }
+
+    // Records one message handed to a desktop socket
+    void record_forwarded(std::chrono::steady_clock::time_point received) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - received);
+        m_metrics.forward_latency_us.record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, elapsed.count())));
+        m_metrics.messages_out[static_cast<int>(ClientType::DESKTOP)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Prometheus text exposition of RelayMetrics, the outbox counters and the
+    // current connection counts
+    std::string render_metrics() {
+        std::ostringstream out;
+        const ClientType types[] = {ClientType::HARDWARE, ClientType::DESKTOP, ClientType::UNKNOWN};
+
+        out << "# HELP airclass_messages_received_total WebSocket messages received, by sender type.\n"
+            << "# TYPE airclass_messages_received_total counter\n";
+        for (ClientType type : types) {
+            out << "airclass_messages_received_total{client_type=\"" << clientTypeLabel(type) << "\"} "
+                << m_metrics.messages_in[static_cast<int>(type)].load(std::memory_order_relaxed) << "\n";
+        }
+        out << "# HELP airclass_messages_sent_total WebSocket messages sent, by receiver type.\n"
+            << "# TYPE airclass_messages_sent_total counter\n";
+        for (ClientType type : types) {
+            out << "airclass_messages_sent_total{client_type=\"" << clientTypeLabel(type) << "\"} "
+                << m_metrics.messages_out[static_cast<int>(type)].load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP airclass_connections Open WebSocket connections, by client type.\n"
+            << "# TYPE airclass_connections gauge\n";
+        for (ClientType type : types) {
+            out << "airclass_connections{client_type=\"" << clientTypeLabel(type) << "\"} "
+                << m_client_counts[static_cast<int>(type)].load(std::memory_order_relaxed) << "\n";
+        }
+        out << "# HELP airclass_rooms Rooms with at least one desktop.\n"
+            << "# TYPE airclass_rooms gauge\n"
+            << "airclass_rooms " << std::atomic_load(&m_rooms)->size() << "\n";
+
+        out << "# HELP airclass_registration_failures_total Rejected registration messages.\n"
+            << "# TYPE airclass_registration_failures_total counter\n"
+            << "airclass_registration_failures_total "
+            << m_metrics.registration_failures.load(std::memory_order_relaxed) << "\n";
+
+        // Receive-to-send latency, buckets at powers of two from 16us to ~16s
+        render_histogram(out, "airclass_forward_latency_seconds",
+                         "Time from receiving a hardware message to handing it to a desktop socket.",
+                         m_metrics.forward_latency_us, 4, 24, 1e-6);
+        // Outbox depth right after each enqueue, buckets 1..4096
+        render_histogram(out, "airclass_outbox_depth",
+                         "Per-desktop outbox depth observed after each enqueue.",
+                         m_metrics.queue_depth, 0, 12, 1.0);
+
+        out << "# HELP airclass_outbox_queued_messages Messages waiting in desktop outboxes.\n"
+            << "# TYPE airclass_outbox_queued_messages gauge\n"
+            << "airclass_outbox_queued_messages " << m_outbox_metrics.queued_messages.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_queued_bytes Payload bytes waiting in desktop outboxes.\n"
+            << "# TYPE airclass_outbox_queued_bytes gauge\n"
+            << "airclass_outbox_queued_bytes " << m_outbox_metrics.queued_bytes.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_peak_depth Deepest single desktop outbox seen.\n"
+            << "# TYPE airclass_outbox_peak_depth gauge\n"
+            << "airclass_outbox_peak_depth " << m_outbox_metrics.peak_depth.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_coalesced_total Positions replaced by a newer one in an outbox.\n"
+            << "# TYPE airclass_outbox_coalesced_total counter\n"
+            << "airclass_outbox_coalesced_total " << m_outbox_metrics.coalesced.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_dropped_bulk_total Bulk messages dropped from full outboxes.\n"
+            << "# TYPE airclass_outbox_dropped_bulk_total counter\n"
+            << "airclass_outbox_dropped_bulk_total " << m_outbox_metrics.dropped_bulk.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_overflow_closes_total Desktops disconnected because commands overflowed.\n"
+            << "# TYPE airclass_outbox_overflow_closes_total counter\n"
+            << "airclass_outbox_overflow_closes_total " << m_outbox_metrics.overflow_closes.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_parked_commands_total Commands kept for a disconnected desktop's return.\n"
+            << "# TYPE airclass_outbox_parked_commands_total counter\n"
+            << "airclass_outbox_parked_commands_total " << m_outbox_metrics.parked_commands.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_outbox_deferred_flushes_total Flushes postponed by the socket high-water mark.\n"
+            << "# TYPE airclass_outbox_deferred_flushes_total counter\n"
+            << "airclass_outbox_deferred_flushes_total " << m_outbox_metrics.deferred_flushes.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_positions_throttled_total Hardware positions dropped by the rate limiter.\n"
+            << "# TYPE airclass_positions_throttled_total counter\n"
+            << "airclass_positions_throttled_total " << m_positions_coalesced.load(std::memory_order_relaxed) << "\n";
+
+        if (m_replay.isOpen()) {
+            std::uint64_t head;
+            {
+                std::lock_guard<std::mutex> replay_guard(m_replay_lock);
+                head = m_replay.head();
+            }
+            out << "# HELP airclass_replay_head_seq Newest relay sequence in the replay log.\n"
+                << "# TYPE airclass_replay_head_seq gauge\n"
+                << "airclass_replay_head_seq " << head << "\n"
+                << "# HELP airclass_replayed_commands_total Commands replayed to reconnecting desktops.\n"
+                << "# TYPE airclass_replayed_commands_total counter\n"
+                << "airclass_replayed_commands_total " << m_replayed_total.load(std::memory_order_relaxed) << "\n"
+                << "# HELP airclass_replay_skipped_total Commands too large (or malformed) for the replay log.\n"
+                << "# TYPE airclass_replay_skipped_total counter\n"
+                << "airclass_replay_skipped_total " << m_replay_skipped.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP airclass_batches_sent_total Batch messages sent to desktops.\n"
+            << "# TYPE airclass_batches_sent_total counter\n"
+            << "airclass_batches_sent_total " << m_outbox_metrics.batches.load(std::memory_order_relaxed) << "\n"
+            << "# HELP airclass_batched_frames_total Gesture frames sent inside batches.\n"
+            << "# TYPE airclass_batched_frames_total counter\n"
+            << "airclass_batched_frames_total " << m_outbox_metrics.batched_frames.load(std::memory_order_relaxed) << "\n";
+
+        if (m_discovery) {
+            out << "# HELP airclass_discovery_announcements_total UDP discovery broadcasts sent.\n"
+                << "# TYPE airclass_discovery_announcements_total counter\n"
+                << "airclass_discovery_announcements_total " << m_discovery->announcements() << "\n"
+                << "# HELP airclass_discovered_desktops Desktops currently answering UDP discovery.\n"
+                << "# TYPE airclass_discovered_desktops gauge\n"
+                << "airclass_discovered_desktops " << m_discovery->peers().size() << "\n";
+        }
+        return out.str();
+    }
+
+    // One Prometheus histogram with cumulative buckets at 2^min_exp .. 2^max_exp
+    // (exact, those are bucket boundaries of the log-linear histogram) plus
+    // p50/p90/p99/p999 gauges. scale converts recorded units to exported ones.
+    static void render_histogram(std::ostringstream& out, const char* name, const char* help,
+                                 const airclass::metrics::LogLinearHistogram& histogram,
+                                 int min_exp, int max_exp, double scale) {
+        out << "# HELP " << name << " " << help << "\n"
+            << "# TYPE " << name << " histogram\n";
+        for (int exp = min_exp; exp <= max_exp; ++exp) {
+            const std::uint64_t bound = std::uint64_t{1} << exp;
+            // Integer values: "<= bound" is "< bound + 1"
+            out << name << "_bucket{le=\"" << static_cast<double>(bound) * scale << "\"} "
+                << histogram.countBelow(bound + 1) << "\n";
+        }
+        const std::uint64_t count = histogram.count();
+        out << name << "_bucket{le=\"+Inf\"} " << count << "\n"
+            << name << "_sum " << static_cast<double>(histogram.sum()) * scale << "\n"
+            << name << "_count " << count << "\n";
+
+        out << "# TYPE " << name << "_quantile gauge\n";
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            out << name << "_quantile{quantile=\"" << q << "\"} "
+                << static_cast<double>(histogram.quantile(q)) * scale << "\n";
+        }
+    }
+
+    // Positions and bulk above their caps; commands do not count
+    bool over_limits(const DesktopOutbox& outbox) const {
+        return outbox.droppable_depth() > m_outbox_limits.max_messages ||
+               outbox.bytes - outbox.command_bytes > m_outbox_limits.max_bytes;
+    }
+
+    // Applies an outbox's change in size to the relay-wide gauges
+    void account(std::size_t depth_before, std::size_t bytes_before, const DesktopOutbox& outbox) {
+        const std::int64_t depth = static_cast<std::int64_t>(outbox.depth());
+        m_outbox_metrics.queued_messages.fetch_add(depth - static_cast<std::int64_t>(depth_before),
+                                                   std::memory_order_relaxed);
+        m_outbox_metrics.queued_bytes.fetch_add(static_cast<std::int64_t>(outbox.bytes) -
+                                                static_cast<std::int64_t>(bytes_before),
+                                                std::memory_order_relaxed);
+        std::int64_t peak = m_outbox_metrics.peak_depth.load(std::memory_order_relaxed);
+        while (depth > peak && !m_outbox_metrics.peak_depth.compare_exchange_weak(peak, depth,
+                                                                                 std::memory_order_relaxed)) {
+        }
+    }
+
+    // Logs the queue counters periodically while anything is queued or was dropped
+    void schedule_outbox_report() {
+        m_server.set_timer(OUTBOX_REPORT_MS, [this](websocketpp::lib::error_code const& ec) {
+            if (ec) return;
+            const std::uint64_t coalesced = m_outbox_metrics.coalesced.load(std::memory_order_relaxed);
+            const std::uint64_t dropped = m_outbox_metrics.dropped_bulk.load(std::memory_order_relaxed);
+            const std::uint64_t closes = m_outbox_metrics.overflow_closes.load(std::memory_order_relaxed);
+            const std::int64_t queued = m_outbox_metrics.queued_messages.load(std::memory_order_relaxed);
+            const std::uint64_t throttled = m_positions_coalesced.load(std::memory_order_relaxed);
+            if (queued != 0 || coalesced != 0 || dropped != 0 || closes != 0 || throttled != 0) {
+                AC_LOG(Info) << "Outbox: positions_throttled=" << throttled << " queued=" << queued
+                             << " bytes=" << m_outbox_metrics.queued_bytes.load(std::memory_order_relaxed)
+                             << " peak_depth=" << m_outbox_metrics.peak_depth.load(std::memory_order_relaxed)
+                             << " coalesced=" << coalesced << " dropped_bulk=" << dropped
+                             << " overflow_closes=" << closes
+                             << " deferred_flushes=" << m_outbox_metrics.deferred_flushes.load(std::memory_order_relaxed);
+            }
+            schedule_outbox_report();
+        });
+    }
+
+    // Sends a hardware position now if this tick has not had one yet, otherwise
+    // parks it as the tick's newest sample (replacing an older parked one)
+    void throttle_position(const ClientInfo& sender, QueuedMessage queued) {
+        PositionThrottle& throttle = *sender.throttle;
+        std::lock_guard<std::mutex> guard(throttle.lock);
+        const auto now = std::chrono::steady_clock::now();
+
+        if (!throttle.timer_armed && now >= throttle.next_send) {
+            throttle.next_send = now + m_position_period;
+            forward_message_to_desktops(sender.room, queued, MessageClass::POSITION);
+            return;
+        }
+        if (throttle.pending.msg) {
+            m_positions_coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        throttle.pending = std::move(queued);
+        if (throttle.timer_armed) return;
+
+        // Trailing flush at the start of the next tick
+        throttle.timer_armed = true;
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            throttle.next_send - now + std::chrono::microseconds(999));
+        std::weak_ptr<PositionThrottle> weak_throttle = sender.throttle;
+        std::string room = sender.room;
+        m_server.set_timer(std::max<long>(0, static_cast<long>(wait.count())),
+                           [this, weak_throttle, room](websocketpp::lib::error_code const& ec) {
+            auto pending_throttle = weak_throttle.lock();
+            if (ec || !pending_throttle) return;
+            std::lock_guard<std::mutex> timer_guard(pending_throttle->lock);
+            pending_throttle->timer_armed = false;
+            if (pending_throttle->pending.msg) {
+                pending_throttle->next_send = std::chrono::steady_clock::now() + m_position_period;
+                forward_message_to_desktops(room, pending_throttle->pending, MessageClass::POSITION);
+                pending_throttle->pending.msg.reset();
+            }
+        });
+    }
+
+    // Forwards a parked position right away (used before a discrete command)
+    void flush_position(const ClientInfo& sender) {
+        if (!sender.throttle) return;
+        std::lock_guard<std::mutex> guard(sender.throttle->lock);
+        if (sender.throttle->pending.msg) {
+            forward_message_to_desktops(sender.room, sender.throttle->pending, MessageClass::POSITION);
+            sender.throttle->pending.msg.reset();
+        }
+    }
+
+    // Validates a hardware message and works out its class. Only binary frames
+    // can be rejected here; JSON text is classified without parsing.
+    static bool classify_message(const message_ptr& msg, MessageClass& message_class) {
+        const std::string& payload = msg->get_payload();
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            airclass::GestureFrame frame;
+            if (!airclass::decodeFrame(payload.data(), payload.size(), frame)) return false;
+            message_class = binary_class(frame);
+        } else {
+            message_class = text_class(payload);
+        }
+        return true;
+    }
+
+    // Position frames carry the position flag; any other valid frame is a command
+    static MessageClass binary_class(const airclass::GestureFrame& frame) {
+        return frame.hasPosition() ? MessageClass::POSITION : MessageClass::COMMAND;
+    }
+
+    // Cheap scan of a JSON payload, no parse: hardware JSON always has "command",
+    // and pointer/drawing updates additionally carry "position"
+    static MessageClass text_class(const std::string& payload) {
+        if (payload.find("\"position\"") != std::string::npos) return MessageClass::POSITION;
+        if (payload.find("\"command\"") != std::string::npos) return MessageClass::COMMAND;
+        return MessageClass::BULK;
+    }
+
+    // Wraps a payload in a message that can sit in several outboxes at once
+    message_ptr make_message(const std::string& payload, websocketpp::frame::opcode::value opcode) const {
+        auto msg = std::make_shared<server::message_type>(nullptr, opcode, payload.size());
+        msg->set_payload(payload);
+        mark_compressible(*msg);
+        return msg;
+    }
+
+    // Asks for permessage-deflate on messages above the size threshold. Only
+    // has an effect on connections that negotiated the extension. Must be
+    // called before the message is shared between threads.
+    void mark_compressible(server::message_type& msg) const {
+        msg.set_compressed(airclass::kDeflateAvailable && msg.get_payload().size() >= m_deflate_min_bytes);
+    }
+
+    // Copy of a command carrying the next relay sequence ("rseq" in JSON, the
+    // relay_seq field in binary frames), appended to the replay log. Returns
+    // the message unchanged if it cannot be logged. Caller holds m_replay_lock.
+    QueuedMessage sequence_message(const std::string& room, const QueuedMessage& queued) {
+        const std::uint64_t seq = m_replay.nextSeq();
+        const auto opcode = queued.msg->get_opcode();
+        std::string payload;
+        if (opcode == websocketpp::frame::opcode::binary) {
+            airclass::GestureFrame frame;
+            const std::string& original = queued.msg->get_payload();
+            if (!airclass::decodeFrame(original.data(), original.size(), frame)) return queued;
+            frame.flags |= airclass::kFlagRelaySeq;
+            frame.relay_seq = seq;
+            char buffer[airclass::kMaxFrameSize];
+            payload.assign(buffer, airclass::encodeFrame(frame, buffer));
+        } else {
+            json data = json::parse(queued.msg->get_payload(), nullptr, false);
+            if (data.is_discarded() || !data.is_object()) return queued;
+            data["rseq"] = seq;
+            payload = data.dump();
+        }
+        if (m_replay.append(room, static_cast<std::uint8_t>(opcode), payload.data(), payload.size()) == 0) {
+            m_replay_skipped.fetch_add(1, std::memory_order_relaxed);
+            return queued;
+        }
+        return QueuedMessage{make_message(payload, opcode), queued.received};
+    }
+
+    // Replay log epoch as sent to desktops: hex, since JSON numbers above 2^53
+    // do not survive every parser
+    static std::string epoch_string(std::uint64_t epoch) {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(epoch));
+        return text;
+    }
+
+    // Logged commands of room after last_seq, converted for the desktop's frame
+    // format, at most what fits its outbox (newest kept). Returns true if the
+    // desktop missed commands that are no longer available. Caller holds
+    // m_replay_lock.
+    bool collect_replay(const std::string& room, std::uint64_t last_seq, int binary,
+                        std::vector<message_ptr>& backlog) {
+        const std::uint64_t head = m_replay.head();
+        if (last_seq >= head) return last_seq > head;  // Nothing new, or a different (reset) log
+
+        const std::size_t cap = std::max<std::size_t>(1, std::min(m_outbox_limits.max_messages - 1,
+                                m_outbox_limits.max_bytes / airclass::ReplayLog::kSlotSize));
+        const std::uint64_t from_seq = head >= cap ? head - cap + 1 : 1;
+        const std::int64_t min_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() - m_replay_max_age_ms;
+
+        m_replay.replay(room, last_seq, from_seq, min_unix_ms, [&](const airclass::ReplayLog::Event& event) {
+            const auto opcode = static_cast<websocketpp::frame::opcode::value>(event.opcode);
+            std::string payload(event.payload, event.length);
+            if (opcode == websocketpp::frame::opcode::binary && binary == 0) {
+                airclass::GestureFrame frame;
+                if (!airclass::decodeFrame(payload.data(), payload.size(), frame)) return;
+                payload = frame_to_json(frame);
+                backlog.push_back(make_message(payload, websocketpp::frame::opcode::text));
+            } else {
+                backlog.push_back(make_message(payload, opcode));
+            }
+        });
+        return last_seq + 1 < std::max(m_replay.oldest(), from_seq);
+    }
+
+    // JSON form of a binary gesture frame, as hardware clients send it in JSON mode
+    static std::string frame_to_json(const airclass::GestureFrame& frame) {
+        json message = {
+            {"command", std::string(airclass::commandName(frame.command))}
+        };
+        if (frame.hasPosition()) {
+            message["position"] = {{"x", frame.x}, {"y", frame.y}};
+            if (frame.hasDepth()) message["position"]["z"] = frame.z;
+        }
+        if (frame.hasTrace()) {
+            message["seq"] = frame.seq;
+            message["capture_us"] = frame.capture_us;
+            message["trace"] = {{"pipe_us", frame.pipe_us}, {"hw_us", frame.hw_us}, {"relay_us", frame.relay_us}};
+        }
+        if (frame.hasRelaySeq()) {
+            message["rseq"] = frame.relay_seq;
+        }
+        return message.dump();
+    }
+
+    // True for hardware messages carrying trace fields (AIRCLASS_TRACE on the Pi)
+    static bool is_traced(const server::message_type& msg) {
+        const std::string& payload = msg.get_payload();
+        if (msg.get_opcode() == websocketpp::frame::opcode::binary) {
+            return payload.size() >= airclass::kTracedFrameSize &&
+                   (static_cast<unsigned char>(payload[2]) & airclass::kFlagTrace) != 0;
+        }
+        return payload.find("\"trace\"") != std::string::npos;
+    }
+
+    // Copy of a traced message with relay_us set to the time since on_message
+    // (including any position throttling). Outbox wait is not included; it
+    // shows up in airclass_forward_latency_seconds instead.
+    QueuedMessage stamp_relay_dwell(const QueuedMessage& queued) const {
+        const auto dwell = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - queued.received).count();
+        const std::uint32_t relay_us = static_cast<std::uint32_t>(std::clamp<long long>(dwell, 0, UINT32_MAX));
+        std::string payload = queued.msg->get_payload();
+        if (queued.msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            airclass::stampRelayDwell(&payload[0], payload.size(), relay_us);
+        } else {
+            try {
+                json data = json::parse(payload);
+                if (!data["trace"].is_object()) return queued;
+                data["trace"]["relay_us"] = relay_us;
+                payload = data.dump();
+            } catch (const json::exception& e) {
+                return queued;
+            }
+        }
+        return QueuedMessage{make_message(payload, queued.msg->get_opcode()), queued.received};
+    }
+
+    // Debug summary of a hardware frame: command and position on one line
+    void log_hardware_message(const ClientInfo& sender, message_ptr msg) {
+        const std::string& payload = msg->get_payload();
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            airclass::GestureFrame frame;
+            if (airclass::decodeFrame(payload.data(), payload.size(), frame)) {
+                AC_LOG(Debug) << "Hardware frame from " << sender.id << " (room '" << sender.room
+                              << "'): command=" << airclass::commandName(frame.command)
+                              << " seq=" << frame.seq;
+                if (frame.hasPosition()) {
+                    AC_LOG(Debug) << "  position x=" << frame.x << " y=" << frame.y;
+                }
+            } else {
+                AC_LOG(Debug) << "Hardware message from " << sender.id << " is not a valid frame ("
+                              << payload.size() << " bytes)";
+            }
+            return;
+        }
+        try {
+            const json data = json::parse(payload);
+            std::string command = data.contains("command") ? data["command"].dump() : "N/A";
+            std::string position = data.contains("position") ? data["position"].dump() : "-";
+            AC_LOG(Debug) << "Hardware message from " << sender.id << " (room '" << sender.room
+                          << "'): command=" << command << " position=" << position;
+        } catch (const json::parse_error& e) {
+            AC_LOG(Debug) << "Hardware message from " << sender.id << " is not JSON: " << payload;
+        }
+    }
+
+    // Sends a structured error JSON to a single (not yet registered) client
+    void send_error(connection_hdl hdl, const std::string& error_message) {
+        json error_json = {
+            {"type", "error"},
+            {"message", error_message}
+        };
+        try {
+            if (!hdl.expired()) {
+                m_server.send(hdl, error_json.dump(), websocketpp::frame::opcode::text);
+                m_metrics.messages_out[static_cast<int>(ClientType::UNKNOWN)].fetch_add(1, std::memory_order_relaxed);
+            }
+        } catch (const websocketpp::exception& e) {
+            AC_LOG(Error) << "Failed to send error: " << e.what();
+        }
+    }
+
+    // Snapshot publication helper. Callers must hold m_connection_lock so that
+    // concurrent writers do not overwrite each other's copies.
+    void publish_rooms(std::shared_ptr<const RoomIndex> next) {
+        std::atomic_store(&m_rooms, std::move(next));
+    }
+
+    // Adds a desktop to its room's subscriber list (creating the room if needed)
+    void add_desktop(const std::string& room, DesktopEntry entry) {
+        auto current = std::atomic_load(&m_rooms);
+        auto list = std::make_shared<DesktopList>();
+        auto room_it = current->find(room);
+        if (room_it != current->end()) {
+            *list = *room_it->second;
+        }
+        list->push_back(std::move(entry));
+
+        auto next = std::make_shared<RoomIndex>(*current);
+        (*next)[room] = std::move(list);
+        publish_rooms(std::move(next));
+    }
+
+    // Removes a desktop from its room, dropping the room once it is empty
+    void remove_desktop(const std::string& room, connection_hdl hdl) {
+        auto current = std::atomic_load(&m_rooms);
+        auto room_it = current->find(room);
+        if (room_it == current->end()) return;
+
+        auto list = std::make_shared<DesktopList>();
+        list->reserve(room_it->second->size());
+        std::owner_less<connection_hdl> less;
+        for (auto const& desktop : *room_it->second) {
+            if (less(desktop.hdl, hdl) || less(hdl, desktop.hdl)) {
+                list->push_back(desktop);
+            } else {
+                // Whatever is still queued for the closed desktop leaves the
+                // gauges; undelivered commands wait for it to come back
+                std::lock_guard<std::mutex> outbox_guard(desktop.outbox->lock);
+                const std::size_t depth_before = desktop.outbox->depth();
+                const std::size_t bytes_before = desktop.outbox->bytes;
+                std::deque<QueuedMessage> commands = desktop.outbox->queued_commands();
+                park_commands(room, desktop.id, commands);
+                desktop.outbox->clear();
+                account(depth_before, bytes_before, *desktop.outbox);
+            }
+        }
+
+        auto next = std::make_shared<RoomIndex>(*current);
+        if (list->empty()) {
+            next->erase(room);
+        } else {
+            (*next)[room] = std::move(list);
+        }
+        publish_rooms(std::move(next));
+    }
+
+    // Keeps the commands a closed desktop never received, for its next
+    // registration with the same ID in the same room. Entries older than the
+    // replay age limit are dropped here. Caller holds m_connection_lock.
+    void park_commands(const std::string& room, const std::string& id, std::deque<QueuedMessage>& commands) {
+        const auto now = std::chrono::steady_clock::now();
+        const auto max_age = std::chrono::milliseconds(m_replay_max_age_ms);
+        for (auto it = m_parked.begin(); it != m_parked.end();) {
+            it = now - it->second.parked > max_age ? m_parked.erase(it) : std::next(it);
+        }
+        if (commands.empty()) return;
+        ParkedCommands& parked = m_parked[room + '\n' + id];
+        parked.parked = now;
+        for (auto& queued : commands) parked.commands.push_back(std::move(queued.msg));
+        while (parked.commands.size() > m_outbox_limits.max_commands) parked.commands.pop_front();
+        m_outbox_metrics.parked_commands.fetch_add(commands.size(), std::memory_order_relaxed);
+        AC_LOG(Info) << "Keeping " << commands.size() << " undelivered command(s) for desktop " << id;
+    }
+
+    // Takes the commands parked for a desktop, converted for its frame format.
+    // Caller holds m_connection_lock.
+    std::vector<message_ptr> take_parked(const std::string& room, const std::string& id, int binary) {
+        std::vector<message_ptr> backlog;
+        auto it = m_parked.find(room + '\n' + id);
+        if (it == m_parked.end()) return backlog;
+        if (std::chrono::steady_clock::now() - it->second.parked <= std::chrono::milliseconds(m_replay_max_age_ms)) {
+            for (auto& msg : it->second.commands) {
+                if (binary == 0 && msg->get_opcode() == websocketpp::frame::opcode::binary) {
+                    airclass::GestureFrame frame;
+                    if (!airclass::decodeFrame(msg->get_payload().data(), msg->get_payload().size(), frame)) continue;
+                    backlog.push_back(make_message(frame_to_json(frame), websocketpp::frame::opcode::text));
+                } else {
+                    backlog.push_back(std::move(msg));
+                }
+            }
+        }
+        m_parked.erase(it);
+        return backlog;
+    }
+
+    // Utility: lowercase ClientType name used as a metrics label
+    static const char* clientTypeLabel(ClientType type) {
+        switch (type) {
+            case ClientType::HARDWARE: return "hardware";
+            case ClientType::DESKTOP:  return "desktop";
+            case ClientType::UNKNOWN:  return "unregistered";
+        }
+        return "invalid";
+    }
+
+    // Utility: convert ClientType enum to a readable string
+    std::string clientTypeToString(ClientType type) {
+        switch (type) {
+            case ClientType::HARDWARE: return "Hardware";
+            case ClientType::DESKTOP:  return "Desktop";
+            case ClientType::UNKNOWN:  return "Unknown";
+        }
+        return "InvalidType";
+    }
+
+    // Utility: registration "register" value to ClientType (UNKNOWN if invalid)
+    static ClientType clientTypeFromString(const std::string& type) {
+        if (type == "hardware") return ClientType::HARDWARE;
+        if (type == "desktop") return ClientType::DESKTOP;
+        return ClientType::UNKNOWN;
+    }
+
+    server m_server;  // Underlying WebSocket++ server instance
+    // Per-connection role and registration data, indexed by the slot bound to each connection
+    ClientSlab m_clients;
+    std::atomic<std::int64_t> m_client_counts[RelayMetrics::kClientTypes] = {};  // Open connections by role
+    // Registered desktops grouped by room; this is what the gesture fan-out walks
+    std::shared_ptr<const RoomIndex> m_rooms;
+    std::mutex m_connection_lock;  // Serializes writers; readers never take it
+    OutboxLimits m_outbox_limits;   // Caps applied to every desktop outbox
+    OutboxMetrics m_outbox_metrics; // Queue depth / drop counters across desktops
+    RelayMetrics m_metrics;         // Traffic counters and histograms for /metrics
+
+    std::size_t m_position_hz = 60;                          // AIRCLASS_POSITION_HZ
+    std::chrono::microseconds m_position_period{1000000 / 60};
+    std::atomic<std::uint64_t> m_positions_coalesced{0};     // Hardware positions never forwarded
+    std::chrono::microseconds m_batch_window{1000};          // AIRCLASS_BATCH_WINDOW_US
+    std::size_t m_deflate_min_bytes = airclass::kDefaultDeflateMinBytes;  // AIRCLASS_DEFLATE_MIN_BYTES
+
+    std::unique_ptr<DesktopDiscovery> m_discovery;  // Background UDP announcer, created by run()
+    std::vector<std::thread> m_workers;              // Event loop threads created by start()
+
+    airclass::ReplayLog m_replay;                    // Recent commands by relay sequence
+    std::mutex m_replay_lock;                        // Serializes sequencing, replay and room joins
+    std::int64_t m_replay_max_age_ms = 900000;       // AIRCLASS_REPLAY_MAX_AGE: older commands are not replayed
+    std::atomic<std::uint64_t> m_replayed_total{0};
+    std::atomic<std::uint64_t> m_replay_skipped{0};
+
+    // Commands a closed desktop never received, waiting for it to reconnect
+    struct ParkedCommands {
+        std::deque<message_ptr> commands;
+        std::chrono::steady_clock::time_point parked;
+    };
+    std::unordered_map<std::string, ParkedCommands> m_parked;  // room + '\n' + id; guarded by m_connection_lock
+
+    static constexpr long OUTBOX_RETRY_MS = 5;       // Recheck a backed-up desktop this often
+    static constexpr long OUTBOX_REPORT_MS = 30000;  // Queue counter log interval
+};
+
+#endif // AIRCLASS_SERVER_HPP
@@ -0,0 +1,510 @@
+// Synthetic load generator for the AirClass relay.
+//
+// Starts M fake hardware clients (the real WebSocketHardwareClient) and N fake
+// desktop clients against a running relay, drives gestures and positions at
+// fixed rates and reports:
+//   - messages/sec sent by the hardware side and delivered to desktops
+//   - forward latency p50/p99/p999/max (hardware send -> desktop receive)
+//   - CPU and RSS of the relay (with --spawn or --pid) and of the bench itself
+//   - WebSocket messages and bytes on the wire from the relay to the desktops
+//
+// Latency comes from the capture_us stamped into every gesture. Senders and
+// receivers live in this process, so they share one monotonic clock.
+//
+// Usage:
+//   relay_bench [--uri ws://127.0.0.1:8080] [--hardware 4] [--desktops 8]
+//               [--rooms 1] [--gesture-hz 2] [--position-hz 30]
+//               [--duration 10] [--warmup 2] [--desktop-threads 2] [--json | --batch]
+//               [--spawn ./server | --pid PID] [--max-p99-ms X]
+//
+// --json registers the desktops without binary frames, so the relay has to
+// convert every gesture. --batch registers them with "batch": true, so frames
+// queued together reach a desktop in one message (see AIRCLASS_BATCH_WINDOW_US);
+// compare its wire line with a plain run. The relay coalesces positions per hardware client to
+// AIRCLASS_POSITION_HZ (60 by default), so position rates above that show up
+// as coalesced rather than delivered. With --max-p99-ms the exit status is 1
+// when p99 exceeds the bound, so the bench can gate a deployment.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "latency_histogram.hpp"
+#include "websocket_hardware_client.hpp"
+
+namespace {
+
+struct BenchConfig {
+    std::string uri = "ws://127.0.0.1:8080";
+    int hardware = 4;             // Fake Raspberry Pis
+    int desktops = 8;             // Fake desktop apps, spread over the rooms
+    int rooms = 1;                // Hardware i and desktop j use room (index % rooms)
+    double gesture_hz = 2.0;      // Discrete commands per hardware client
+    double position_hz = 30.0;    // two_up position updates per hardware client
+    double duration_s = 10.0;     // Measured interval
+    double warmup_s = 2.0;        // Run before measuring (connections, caches)
+    int desktop_threads = 2;      // ASIO threads shared by all fake desktops
+    bool json_desktops = false;   // Desktops register without binary frames
+    bool batch_desktops = false;  // Desktops accept batched frames
+    std::string spawn;            // Relay binary to start for the run
+    pid_t pid = 0;                // Relay process to sample (spawned or given)
+    double max_p99_ms = 0.0;      // Fail the run above this p99 (0 = no gate)
+};
+
+// Process CPU time (user + system) and memory from /proc
+struct ProcSample {
+    bool valid = false;
+    double cpu_s = 0.0;
+    long rss_kb = 0;
+    long hwm_kb = 0;
+};
+
+ProcSample sampleProcess(pid_t pid) {
+    ProcSample sample;
+    const std::string base = pid == 0 ? "/proc/self" : "/proc/" + std::to_string(pid);
+
+    std::ifstream stat_file(base + "/stat");
+    std::string stat;
+    if (!std::getline(stat_file, stat)) return sample;
+    // Fields after the command name, which may contain spaces, start at 3
+    const auto close_paren = stat.rfind(')');
+    if (close_paren == std::string::npos) return sample;
+    std::istringstream fields(stat.substr(close_paren + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int index = 3; fields >> field; ++index) {
+        if (index == 14) utime = std::strtoull(field.c_str(), nullptr, 10);
+        if (index == 15) { stime = std::strtoull(field.c_str(), nullptr, 10); break; }
+    }
+    sample.cpu_s = static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    std::ifstream status_file(base + "/status");
+    std::string line;
+    while (std::getline(status_file, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) sample.rss_kb = std::atol(line.c_str() + 6);
+        if (line.compare(0, 6, "VmHWM:") == 0) sample.hwm_kb = std::atol(line.c_str() + 6);
+    }
+    sample.valid = true;
+    return sample;
+}
+
+// Port part of ws://host:port/path, for starting a relay with --spawn
+std::string portOf(const std::string& uri) {
+    const auto host_start = uri.find("//");
+    const auto colon = uri.find(':', host_start == std::string::npos ? 0 : host_start + 2);
+    if (colon == std::string::npos) return "80";
+    return uri.substr(colon + 1, uri.find('/', colon) - colon - 1);
+}
+
+// Bytes a server-to-client WebSocket message of this payload takes on the
+// wire: the payload plus an unmasked frame header (TCP/IP overhead excluded)
+std::uint64_t wireSize(std::size_t payload) {
+    const std::size_t header = payload < 126 ? 2 : payload <= 0xFFFF ? 4 : 10;
+    return payload + header;
+}
+
+// All fake desktops share one client endpoint and its ASIO threads. Every
+// gesture they receive is decoded like the desktop app does and its age
+// recorded in the latency histogram.
+class DesktopFleet {
+public:
+    DesktopFleet() {
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.clear_error_channels(websocketpp::log::elevel::all);
+        m_client.init_asio();
+        m_client.start_perpetual();
+    }
+
+    ~DesktopFleet() {
+        stop();
+    }
+
+    void start(const BenchConfig& config) {
+        for (int i = 0; i < std::max(1, config.desktop_threads); ++i) {
+            m_threads.emplace_back([this]() { m_client.run(); });
+        }
+        for (int j = 0; j < config.desktops; ++j) {
+            websocketpp::lib::error_code ec;
+            client::connection_ptr con = m_client.get_connection(config.uri, ec);
+            if (ec) {
+                AC_LOG(Error) << "Desktop connection setup failed: " << ec.message();
+                continue;
+            }
+            json registration = {
+                {"register", "desktop"},
+                {"id", "bench-desktop-" + std::to_string(j)},
+                {"room", "bench-room-" + std::to_string(j % config.rooms)},
+                {"binary", config.json_desktops ? 0 : airclass::kFrameVersion},
+                {"batch", config.batch_desktops}
+            };
+            const std::string registration_text = registration.dump();
+            con->set_open_handler([this, registration_text](connection_hdl hdl) {
+                websocketpp::lib::error_code send_ec;
+                m_client.send(hdl, registration_text, websocketpp::frame::opcode::text, send_ec);
+            });
+            con->set_fail_handler([](connection_hdl) {
+                AC_LOG(Error) << "Desktop connection failed";
+            });
+            con->set_message_handler(bind(&DesktopFleet::on_message, this, _1, _2));
+            m_client.connect(con);
+            m_hdls.push_back(con->get_handle());
+        }
+    }
+
+    // Waits until every desktop got its registration confirmation
+    bool waitRegistered(int expected, std::chrono::seconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (m_registered.load() < expected) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return true;
+    }
+
+    void setMeasuring(bool measuring) { m_measuring = measuring; }
+
+    void stop() {
+        if (m_stopped.exchange(true)) return;
+        for (auto& hdl : m_hdls) {
+            websocketpp::lib::error_code ec;
+            m_client.close(hdl, websocketpp::close::status::going_away, "Bench done", ec);
+        }
+        m_client.stop_perpetual();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        m_client.stop();
+        for (auto& thread : m_threads) thread.join();
+    }
+
+    const airclass::metrics::LogLinearHistogram& latency() const { return m_latency_us; }
+    std::uint64_t delivered() const { return m_delivered.load(); }
+    std::uint64_t untimed() const { return m_untimed.load(); }
+    std::uint64_t wireMessages() const { return m_wire_messages.load(); }
+    std::uint64_t wireBytes() const { return m_wire_bytes.load(); }
+    int registered() const { return m_registered.load(); }
+
+private:
+    void on_message(connection_hdl, message_ptr msg) {
+        const std::uint64_t now_us = steadyNowUs();
+        const std::string& payload = msg->get_payload();
+        if (m_measuring.load(std::memory_order_relaxed)) {
+            m_wire_messages.fetch_add(1, std::memory_order_relaxed);
+            m_wire_bytes.fetch_add(wireSize(payload.size()), std::memory_order_relaxed);
+        }
+
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            if (airclass::isBatch(payload.data(), payload.size())) {
+                airclass::forEachInBatch(payload.data(), payload.size(),
+                    [this, now_us](const unsigned char* frame, std::size_t length) {
+                        handleFrame(frame, length, now_us);
+                    });
+            } else {
+                handleFrame(payload.data(), payload.size(), now_us);
+            }
+            return;
+        }
+
+        json data = json::parse(payload, nullptr, false);
+        if (data.is_discarded() || !data.is_object()) return;
+        if (data.value("type", "") == "registration_success") {
+            m_registered++;
+            return;
+        }
+        if (!data.contains("command")) return;
+        record(data.value("capture_us", std::uint64_t{0}), now_us);
+    }
+
+    void handleFrame(const void* data, std::size_t length, std::uint64_t now_us) {
+        airclass::GestureFrame frame;
+        if (!airclass::decodeFrame(data, length, frame)) return;
+        record(frame.capture_us, now_us);
+    }
+
+    void record(std::uint64_t capture_us, std::uint64_t now_us) {
+        if (!m_measuring.load(std::memory_order_relaxed)) return;
+        m_delivered.fetch_add(1, std::memory_order_relaxed);
+        if (capture_us == 0 || capture_us > now_us) {
+            m_untimed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_latency_us.record(now_us - capture_us);
+    }
+
+    client                                 m_client;
+    std::vector<std::thread>               m_threads;
+    std::vector<connection_hdl>            m_hdls;
+    std::atomic<int>                       m_registered{0};
+    std::atomic<bool>                      m_measuring{false};
+    std::atomic<bool>                      m_stopped{false};
+    std::atomic<std::uint64_t>             m_delivered{0};
+    std::atomic<std::uint64_t>             m_untimed{0};   // JSON without capture_us
+    std::atomic<std::uint64_t>             m_wire_messages{0};  // WebSocket messages, batches count once
+    std::atomic<std::uint64_t>             m_wire_bytes{0};     // Payload plus frame header
+    airclass::metrics::LogLinearHistogram  m_latency_us;
+};
+
+// Commands a fake Pi cycles through between position updates
+const CommandType kGestureCycle[] = {
+    CommandType::RIGHT, CommandType::LEFT, CommandType::LIKE,
+    CommandType::DISLIKE, CommandType::ZOOM_IN, CommandType::ZOOM_RESET,
+};
+
+// Sends gestures and positions for one hardware client until stop is set.
+// Counts only while measuring is set.
+void driveHardware(WebSocketHardwareClient& hardware, const BenchConfig& config, int index,
+                   const std::atomic<bool>& stop, const std::atomic<bool>& measuring,
+                   std::atomic<std::uint64_t>& sent, std::atomic<std::uint64_t>& send_errors) {
+    using clock = std::chrono::steady_clock;
+    const auto period = [](double hz) {
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / hz));
+    };
+    const bool gestures = config.gesture_hz > 0.0;
+    const bool positions = config.position_hz > 0.0;
+    if (!gestures && !positions) return;
+
+    // Stagger the clients so they do not all fire at the same instant
+    const auto offset = std::chrono::microseconds(997 * index % 10000);
+    auto next_gesture = clock::now() + offset;
+    auto next_position = next_gesture;
+    std::size_t gesture_index = static_cast<std::size_t>(index);
+    double x = 0.0;
+
+    while (!stop.load()) {
+        auto now = clock::now();
+        bool is_position = positions && (!gestures || next_position <= next_gesture);
+        auto due = is_position ? next_position : next_gesture;
+        if (due > now) {
+            std::this_thread::sleep_until(due);
+            now = clock::now();
+        }
+
+        // Stamped as if just captured and read from the pipe, so JSON peers
+        // also carry capture_us (only traced JSON messages do)
+        CommandTrace trace;
+        trace.capture_us = steadyNowUs();
+        trace.read_us = trace.capture_us;
+
+        bool ok;
+        if (is_position) {
+            x = x >= 1.0 ? 0.0 : x + 0.01;
+            ok = hardware.sendCommand(CommandType::TWO_UP, json{{"x", x}, {"y", 0.5}}, trace);
+            next_position += period(config.position_hz);
+            if (next_position < now) next_position = now;  // Do not burst after a stall
+        } else {
+            const CommandType command = kGestureCycle[gesture_index++ % (sizeof(kGestureCycle) / sizeof(kGestureCycle[0]))];
+            ok = hardware.sendCommand(command, json(), trace);
+            next_gesture += period(config.gesture_hz);
+            if (next_gesture < now) next_gesture = now;
+        }
+
+        if (measuring.load(std::memory_order_relaxed)) {
+            (ok ? sent : send_errors).fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool parseArgs(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json") { config.json_desktops = true; continue; }
+        if (arg == "--batch") { config.batch_desktops = true; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (arg == "--uri") config.uri = value;
+            else if (arg == "--hardware") config.hardware = std::max(1, std::stoi(value));
+            else if (arg == "--desktops") config.desktops = std::max(1, std::stoi(value));
+            else if (arg == "--rooms") config.rooms = std::max(1, std::stoi(value));
+            else if (arg == "--gesture-hz") config.gesture_hz = std::max(0.0, std::stod(value));
+            else if (arg == "--position-hz") config.position_hz = std::max(0.0, std::stod(value));
+            else if (arg == "--duration") config.duration_s = std::max(1.0, std::stod(value));
+            else if (arg == "--warmup") config.warmup_s = std::max(0.0, std::stod(value));
+            else if (arg == "--desktop-threads") config.desktop_threads = std::max(1, std::stoi(value));
+            else if (arg == "--spawn") config.spawn = value;
+            else if (arg == "--pid") config.pid = static_cast<pid_t>(std::stoi(value));
+            else if (arg == "--max-p99-ms") config.max_p99_ms = std::stod(value);
+            else {
+                std::cerr << "Unknown option " << arg << "\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Starts the relay binary on the port of the bench URI
+pid_t spawnRelay(const BenchConfig& config) {
+    const std::string port = portOf(config.uri);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        unsetenv("PORT");  // The relay prefers PORT over its argument
+        execl(config.spawn.c_str(), config.spawn.c_str(), port.c_str(), static_cast<char*>(nullptr));
+        std::perror("exec relay");
+        _exit(127);
+    }
+    return pid;
+}
+
+double ms(std::uint64_t us) {
+    return static_cast<double>(us) / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) return 2;
+    if (config.json_desktops && config.batch_desktops) {
+        std::cerr << "--batch needs binary frames; drop --json\n";
+        return 2;
+    }
+
+    // The clients log every connection at info; keep the report readable
+    if (std::getenv("AIRCLASS_LOG_LEVEL") == nullptr) {
+        airclass::logging::threshold().store(static_cast<int>(airclass::logging::Level::Warn));
+    }
+
+    bool spawned = false;
+    if (!config.spawn.empty()) {
+        config.pid = spawnRelay(config);
+        if (config.pid < 0) {
+            std::perror("fork");
+            return 2;
+        }
+        spawned = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));  // Let it listen
+    }
+
+    std::cout << "AirClass relay bench: " << config.hardware << " hardware, " << config.desktops
+              << " desktops (" << (config.json_desktops ? "JSON" : config.batch_desktops ? "binary, batched" : "binary")
+              << "), "
+              << config.rooms << " room(s), " << config.gesture_hz << " gestures/s + "
+              << config.position_hz << " positions/s per hardware client, "
+              << config.duration_s << "s after " << config.warmup_s << "s warmup\n";
+
+    DesktopFleet desktops;
+    desktops.start(config);
+    if (!desktops.waitRegistered(config.desktops, std::chrono::seconds(10))) {
+        std::cerr << "Only " << desktops.registered() << "/" << config.desktops
+                  << " desktops registered at " << config.uri << "\n";
+        if (spawned) { kill(config.pid, SIGTERM); waitpid(config.pid, nullptr, 0); }
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<WebSocketHardwareClient>> hardware;
+    for (int i = 0; i < config.hardware; ++i) {
+        hardware.push_back(std::make_unique<WebSocketHardwareClient>(
+            config.uri, "bench-hw-" + std::to_string(i), "bench-room-" + std::to_string(i % config.rooms)));
+        hardware.back()->setTracing(true);
+        if (!hardware.back()->connect()) {
+            std::cerr << "Hardware client " << i << " could not connect to " << config.uri << "\n";
+            if (spawned) { kill(config.pid, SIGTERM); waitpid(config.pid, nullptr, 0); }
+            return 2;
+        }
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> measuring{false};
+    std::atomic<std::uint64_t> sent{0};
+    std::atomic<std::uint64_t> send_errors{0};
+    std::vector<std::thread> drivers;
+    for (int i = 0; i < config.hardware; ++i) {
+        drivers.emplace_back(driveHardware, std::ref(*hardware[i]), std::cref(config), i,
+                             std::cref(stop), std::cref(measuring), std::ref(sent), std::ref(send_errors));
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.warmup_s));
+
+    const ProcSample relay_start = config.pid > 0 ? sampleProcess(config.pid) : ProcSample();
+    const ProcSample self_start = sampleProcess(0);
+    const auto start = std::chrono::steady_clock::now();
+    measuring = true;
+    desktops.setMeasuring(true);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.duration_s));
+
+    measuring = false;
+    desktops.setMeasuring(false);
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const ProcSample relay_end = config.pid > 0 ? sampleProcess(config.pid) : ProcSample();
+    const ProcSample self_end = sampleProcess(0);
+
+    stop = true;
+    for (auto& driver : drivers) driver.join();
+    for (auto& hw : hardware) hw->stop();
+    desktops.stop();
+    if (spawned) {
+        kill(config.pid, SIGTERM);
+        waitpid(config.pid, nullptr, 0);
+    }
+
+    // Each message reaches every desktop of its room
+    std::uint64_t expected = 0;
+    for (int i = 0; i < config.hardware; ++i) {
+        int room_desktops = 0;
+        for (int j = 0; j < config.desktops; ++j) room_desktops += (j % config.rooms) == (i % config.rooms);
+        expected += static_cast<std::uint64_t>(room_desktops);
+    }
+    const double sent_rate = static_cast<double>(sent.load()) / elapsed_s;
+    const double fanout_rate = sent_rate * static_cast<double>(expected) / config.hardware;
+    const double delivered_rate = static_cast<double>(desktops.delivered()) / elapsed_s;
+
+    const double wire_rate = static_cast<double>(desktops.wireBytes()) / elapsed_s;
+    const double bytes_per_gesture = desktops.delivered() > 0
+        ? static_cast<double>(desktops.wireBytes()) / static_cast<double>(desktops.delivered()) : 0.0;
+
+    const auto& latency = desktops.latency();
+    const double p50 = ms(latency.quantile(0.50));
+    const double p99 = ms(latency.quantile(0.99));
+    const double p999 = ms(latency.quantile(0.999));
+
+    std::printf("\n");
+    std::printf("sent        %10.1f msg/s  (%llu messages, %llu send errors)\n", sent_rate,
+                static_cast<unsigned long long>(sent.load()), static_cast<unsigned long long>(send_errors.load()));
+    std::printf("delivered   %10.1f msg/s  (%llu messages, %.1f msg/s before position coalescing)\n",
+                delivered_rate, static_cast<unsigned long long>(desktops.delivered()), fanout_rate);
+    std::printf("latency ms  p50 %.3f  p99 %.3f  p999 %.3f  max %.3f  (%llu timed, %llu untimed)\n",
+                p50, p99, p999, ms(latency.max()),
+                static_cast<unsigned long long>(latency.count()), static_cast<unsigned long long>(desktops.untimed()));
+    std::printf("wire        %10.1f B/s    (%llu WebSocket messages, %.1f bytes per delivered gesture)\n",
+                wire_rate, static_cast<unsigned long long>(desktops.wireMessages()), bytes_per_gesture);
+    if (relay_start.valid && relay_end.valid) {
+        std::printf("relay       cpu %.1f%%  rss %ld kB  peak rss %ld kB\n",
+                    100.0 * (relay_end.cpu_s - relay_start.cpu_s) / elapsed_s, relay_end.rss_kb, relay_end.hwm_kb);
+    } else {
+        std::printf("relay       cpu/rss not sampled (use --spawn or --pid)\n");
+    }
+    std::printf("bench       cpu %.1f%%  rss %ld kB\n",
+                100.0 * (self_end.cpu_s - self_start.cpu_s) / elapsed_s, self_end.rss_kb);
+
+    // One line for scripts comparing runs
+    std::printf("RESULT sent_per_s=%.1f delivered_per_s=%.1f p50_ms=%.3f p99_ms=%.3f p999_ms=%.3f "
+                "wire_bytes_per_gesture=%.1f relay_cpu_pct=%.1f relay_rss_kb=%ld\n",
+                sent_rate, delivered_rate, p50, p99, p999, bytes_per_gesture,
+                relay_end.valid ? 100.0 * (relay_end.cpu_s - relay_start.cpu_s) / elapsed_s : 0.0,
+                relay_end.valid ? relay_end.rss_kb : 0L);
+
+    if (desktops.delivered() == 0) {
+        std::fprintf(stderr, "No messages were delivered\n");
+        return 1;
+    }
+    if (config.max_p99_ms > 0.0 && p99 > config.max_p99_ms) {
+        std::fprintf(stderr, "p99 %.3f ms exceeds --max-p99-ms %.3f\n", p99, config.max_p99_ms);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,255 @@
+// Append-only ring of recent room events, memory-mapped from a file so it
+// survives relay restarts.
+//
+// Every logged event gets the next relay sequence number ("rseq"), one counter
+// for all rooms. A reconnecting desktop sends the last rseq it saw and gets
+// back only the newer events of its room. Each log has a random epoch, so an
+// rseq from another relay (or a log that was reset) is not mistaken for one
+// of ours. The file holds a small header and a
+// fixed number of fixed-size slots; event N lives in slot N % slot_count, so
+// the newest slot_count events are retained. Events larger than a slot are not
+// logged.
+//
+// Writes go to the shared mapping and reach the disk with the page cache, so a
+// relay crash loses nothing; a power cut may lose the most recent events.
+//
+// Not thread-safe: the relay serializes append() and replay() with its own lock.
+// One process at a time: open() takes an exclusive lock on the file and fails
+// while another relay holds it.
+
+#ifndef AIRCLASS_REPLAY_LOG_HPP
+#define AIRCLASS_REPLAY_LOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace airclass {
+
+class ReplayLog {
+public:
+    static constexpr std::size_t kSlotSize = 512;
+    static constexpr std::size_t kMaxRoomLength = 63;
+
+    // One retained event, as handed to the replay() callback
+    struct Event {
+        std::uint64_t seq;
+        std::int64_t unix_ms;   // Wall clock when logged (comparable across restarts)
+        std::uint8_t opcode;    // WebSocket opcode of the payload
+        const char* payload;
+        std::size_t length;
+    };
+
+    ReplayLog() = default;
+    ReplayLog(const ReplayLog&) = delete;
+    ReplayLog& operator=(const ReplayLog&) = delete;
+
+    ~ReplayLog() {
+        close();
+    }
+
+    // Maps path with room for slot_count events, creating or resetting the file
+    // when it does not match. Refuses symlinks and anything but a regular file,
+    // and a file another process has open as its log (EWOULDBLOCK). Returns
+    // false (with errno set) if it cannot.
+    bool open(const std::string& path, std::size_t slot_count) {
+        close();
+        if (slot_count == 0) return false;
+        const std::size_t size = sizeof(Header) + slot_count * kSlotSize;
+
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) return false;
+        // Held until close(); nothing is truncated or zeroed before we own it
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            closeKeepingErrno(fd);
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            closeKeepingErrno(fd);
+            return false;
+        }
+        if (!S_ISREG(info.st_mode)) {
+            ::close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        const bool fresh = static_cast<std::size_t>(info.st_size) != size;
+        if (fresh && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            closeKeepingErrno(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            closeKeepingErrno(fd);
+            return false;
+        }
+        m_fd = fd;
+
+        m_base = static_cast<unsigned char*>(mapping);
+        m_size = size;
+        m_header = reinterpret_cast<Header*>(m_base);
+        m_slot_count = slot_count;
+
+        if (fresh || std::memcmp(m_header->magic, kMagic, sizeof(kMagic)) != 0 ||
+            m_header->slot_size != kSlotSize || m_header->slot_count != slot_count) {
+            std::memset(m_base, 0, m_size);
+            std::memcpy(m_header->magic, kMagic, sizeof(kMagic));
+            m_header->slot_size = kSlotSize;
+            m_header->slot_count = slot_count;
+        } else {
+            recover();
+        }
+        // Logs written before epochs existed get one now
+        while (m_header->epoch == 0) {
+            std::random_device random;
+            m_header->epoch = (static_cast<std::uint64_t>(random()) << 32) | random();
+        }
+        return true;
+    }
+
+    void close() {
+        if (m_base != nullptr) {
+            munmap(m_base, m_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);  // Releases the lock
+        }
+        m_fd = -1;
+        m_base = nullptr;
+        m_header = nullptr;
+        m_size = 0;
+        m_slot_count = 0;
+    }
+
+    bool isOpen() const { return m_base != nullptr; }
+
+    // Identifies this log's sequence space; changes whenever the log is reset
+    std::uint64_t epoch() const { return m_header ? m_header->epoch : 0; }
+
+    // Sequence of the newest event (0 if none was ever logged)
+    std::uint64_t head() const { return m_header ? m_header->head : 0; }
+
+    // Oldest sequence still retained
+    std::uint64_t oldest() const {
+        const std::uint64_t newest = head();
+        return newest >= m_slot_count ? newest - m_slot_count + 1 : 1;
+    }
+
+    // Sequence the next append() will use
+    std::uint64_t nextSeq() const { return head() + 1; }
+
+    // Whether an event of this size for this room fits in a slot
+    static bool fits(const std::string& room, std::size_t length) {
+        return room.size() <= kMaxRoomLength && length <= kPayloadCapacity;
+    }
+
+    // Stores an event under nextSeq(). Returns its sequence, or 0 if it does not fit.
+    std::uint64_t append(const std::string& room, std::uint8_t opcode, const char* payload, std::size_t length) {
+        if (!isOpen() || !fits(room, length)) return 0;
+        const std::uint64_t seq = nextSeq();
+        Slot* slot = slotAt(seq);
+
+        // Invalidate the slot first so a torn write is never mistaken for an event
+        slot->seq = 0;
+        slot->unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        slot->opcode = opcode;
+        slot->room_length = static_cast<std::uint8_t>(room.size());
+        slot->payload_length = static_cast<std::uint16_t>(length);
+        std::memcpy(slot->room, room.data(), room.size());
+        std::memcpy(slot->payload, payload, length);
+        __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+        __atomic_store_n(&m_header->head, seq, __ATOMIC_RELEASE);
+        return seq;
+    }
+
+    // Calls fn(const Event&) for every retained event of room with a sequence
+    // after after_seq and logged at or after min_unix_ms, oldest first, starting
+    // no earlier than from_seq. Returns the number of events passed to fn.
+    template <typename Fn>
+    std::size_t replay(const std::string& room, std::uint64_t after_seq, std::uint64_t from_seq,
+                       std::int64_t min_unix_ms, Fn&& fn) const {
+        if (!isOpen()) return 0;
+        std::size_t count = 0;
+        std::uint64_t seq = after_seq + 1;
+        if (seq < oldest()) seq = oldest();
+        if (seq < from_seq) seq = from_seq;
+        for (const std::uint64_t newest = head(); seq <= newest; ++seq) {
+            const Slot* slot = slotAt(seq);
+            if (slot->seq != seq || slot->unix_ms < min_unix_ms) continue;
+            if (slot->room_length != room.size() || std::memcmp(slot->room, room.data(), room.size()) != 0) continue;
+            fn(Event{seq, slot->unix_ms, slot->opcode, slot->payload, slot->payload_length});
+            count++;
+        }
+        return count;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'A', 'C', 'R', 'E', 'P', 'L', 'A', 'Y'};
+
+    struct Header {
+        char magic[8];
+        std::uint64_t slot_size;
+        std::uint64_t slot_count;
+        std::uint64_t head;        // Newest sequence written
+        std::uint64_t epoch;       // Random, chosen when the log is created
+        unsigned char reserved[24];
+    };
+
+    static constexpr std::size_t kSlotHeader = 8 + 8 + 1 + 1 + 2 + 4 + (kMaxRoomLength + 1);
+    static constexpr std::size_t kPayloadCapacity = kSlotSize - kSlotHeader;
+
+    struct Slot {
+        std::uint64_t seq;             // 0 while empty or being written
+        std::int64_t unix_ms;
+        std::uint8_t opcode;
+        std::uint8_t room_length;
+        std::uint16_t payload_length;
+        std::uint32_t reserved;
+        char room[kMaxRoomLength + 1];
+        char payload[kPayloadCapacity];
+    };
+    static_assert(sizeof(Slot) == kSlotSize, "replay slot layout");
+
+    Slot* slotAt(std::uint64_t seq) const {
+        return reinterpret_cast<Slot*>(m_base + sizeof(Header) + (seq % m_slot_count) * kSlotSize);
+    }
+
+    // After a crash head may lag the newest slot written; take the larger
+    void recover() {
+        std::uint64_t newest = m_header->head;
+        for (std::size_t i = 0; i < m_slot_count; ++i) {
+            const Slot* slot = reinterpret_cast<const Slot*>(m_base + sizeof(Header) + i * kSlotSize);
+            if (slot->seq > newest && slot->seq % m_slot_count == i) newest = slot->seq;
+        }
+        m_header->head = newest;
+    }
+
+    static void closeKeepingErrno(int fd) {
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+    }
+
+    int m_fd = -1;                 // Open while mapped; holds the flock
+    unsigned char* m_base = nullptr;
+    std::size_t m_size = 0;
+    Header* m_header = nullptr;
+    std::size_t m_slot_count = 0;
+};
+
+} // namespace airclass
+
+#endif // AIRCLASS_REPLAY_LOG_HPP
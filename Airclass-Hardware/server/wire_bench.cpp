@@ -0,0 +1,217 @@
+// Offline comparison of the relay -> desktop encodings of a gesture stream.
+//
+// Encodes the same synthetic stream (mostly two_up positions with a command
+// every few frames, arriving in bursts) as:
+//   - JSON text messages
+//   - binary gesture frames, one per message
+//   - binary frames batched per burst (what "batch": true desktops receive)
+// and each of those once more through permessage-deflate as WebSocket++ does
+// it: raw deflate, context kept across messages, sync flush with the trailing
+// 00 00 ff ff removed (RFC 7692). Reports bytes on the wire per gesture and
+// the sender's CPU time per gesture for every combination.
+//
+// No network is involved; run relay_bench --batch against a relay for latency.
+//
+// Usage:
+//   wire_bench [--gestures 100000] [--burst 3] [--traced] [--level 6]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <nlohmann/json.hpp>
+
+#include "gesture_frame.hpp"
+
+namespace {
+
+using json = nlohmann::json;
+
+struct WireConfig {
+    int gestures = 100000;   // Gestures in the stream
+    int burst = 3;           // Gestures that reach the relay within one batch window
+    bool traced = false;     // Include the trace fields
+    int level = Z_DEFAULT_COMPRESSION;
+};
+
+// Bytes of a server-to-client WebSocket frame header for this payload
+std::size_t headerSize(std::size_t payload) {
+    return payload < 126 ? 2 : payload <= 0xFFFF ? 4 : 10;
+}
+
+std::vector<airclass::GestureFrame> makeStream(const WireConfig& config) {
+    std::vector<airclass::GestureFrame> stream;
+    stream.reserve(config.gestures);
+    std::uint64_t capture_us = 1000000;
+    for (int i = 0; i < config.gestures; ++i) {
+        airclass::GestureFrame frame;
+        frame.seq = static_cast<std::uint32_t>(i);
+        frame.capture_us = capture_us;
+        capture_us += 16667;
+        if (i % 8 == 7) {
+            frame.command = airclass::CommandType::RIGHT;
+        } else {
+            frame.command = airclass::CommandType::TWO_UP;
+            frame.flags |= airclass::kFlagPosition;
+            frame.x = 0.25 + 0.5 * ((i * 37) % 1000) / 1000.0;
+            frame.y = 0.25 + 0.5 * ((i * 91) % 1000) / 1000.0;
+        }
+        if (config.traced) {
+            frame.flags |= airclass::kFlagTrace;
+            frame.pipe_us = 800 + i % 300;
+            frame.hw_us = 40 + i % 20;
+            frame.relay_us = 25 + i % 10;
+        }
+        stream.push_back(frame);
+    }
+    return stream;
+}
+
+std::string toJson(const airclass::GestureFrame& frame) {
+    json message = {{"command", std::string(airclass::commandName(frame.command))}};
+    if (frame.hasPosition()) {
+        message["position"] = {{"x", frame.x}, {"y", frame.y}};
+    }
+    if (frame.hasTrace()) {
+        message["seq"] = frame.seq;
+        message["capture_us"] = frame.capture_us;
+        message["trace"] = {{"pipe_us", frame.pipe_us}, {"hw_us", frame.hw_us}, {"relay_us", frame.relay_us}};
+    }
+    return message.dump();
+}
+
+// permessage-deflate sender with context takeover, one per connection
+class Deflater {
+public:
+    explicit Deflater(int level) {
+        m_stream = z_stream();
+        deflateInit2(&m_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    }
+    ~Deflater() { deflateEnd(&m_stream); }
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    // Compressed size of one message payload
+    std::size_t compress(const std::string& payload) {
+        m_buffer.resize(deflateBound(&m_stream, payload.size()) + 16);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+        m_stream.avail_in = static_cast<uInt>(payload.size());
+        m_stream.next_out = m_buffer.data();
+        m_stream.avail_out = static_cast<uInt>(m_buffer.size());
+        deflate(&m_stream, Z_SYNC_FLUSH);
+        const std::size_t written = m_buffer.size() - m_stream.avail_out;
+        return written >= 4 ? written - 4 : written;  // Drop the 00 00 ff ff tail
+    }
+
+private:
+    z_stream m_stream;
+    std::vector<Bytef> m_buffer;
+};
+
+struct Result {
+    std::uint64_t messages = 0;
+    std::uint64_t wire_bytes = 0;
+    double cpu_ns = 0.0;
+};
+
+// Encodes the stream into messages (one per gesture, or one per burst) and
+// measures wire bytes, optionally deflating every message
+template <typename Encode>
+Result run(const std::vector<airclass::GestureFrame>& stream, int burst, bool deflate, int level, Encode&& encode) {
+    Result result;
+    Deflater deflater(level);
+    std::string payload;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < stream.size(); i += burst) {
+        const std::size_t end = std::min(stream.size(), i + burst);
+        for (auto& message : encode(stream, i, end, payload)) {
+            const std::size_t size = deflate ? deflater.compress(message) : message.size();
+            result.wire_bytes += size + headerSize(size);
+            result.messages++;
+        }
+    }
+    result.cpu_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool parseArgs(int argc, char* argv[], WireConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--traced") { config.traced = true; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (arg == "--gestures") config.gestures = std::max(1, std::stoi(value));
+            else if (arg == "--burst") config.burst = std::max(1, std::min(255, std::stoi(value)));
+            else if (arg == "--level") config.level = std::max(0, std::min(9, std::stoi(value)));
+            else {
+                std::cerr << "Unknown option " << arg << "\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    WireConfig config;
+    if (!parseArgs(argc, argv, config)) return 2;
+    const auto stream = makeStream(config);
+
+    typedef std::vector<std::string> Messages;
+    auto encodeJson = [](const std::vector<airclass::GestureFrame>& frames, std::size_t begin, std::size_t end,
+                         std::string&) {
+        Messages messages;
+        for (std::size_t i = begin; i < end; ++i) messages.push_back(toJson(frames[i]));
+        return messages;
+    };
+    auto encodeBinary = [](const std::vector<airclass::GestureFrame>& frames, std::size_t begin, std::size_t end,
+                           std::string&) {
+        Messages messages;
+        unsigned char buffer[airclass::kMaxFrameSize];
+        for (std::size_t i = begin; i < end; ++i) {
+            const std::size_t length = airclass::encodeFrame(frames[i], buffer);
+            messages.emplace_back(reinterpret_cast<const char*>(buffer), length);
+        }
+        return messages;
+    };
+    auto encodeBatch = [](const std::vector<airclass::GestureFrame>& frames, std::size_t begin, std::size_t end,
+                          std::string& payload) {
+        unsigned char buffer[airclass::kMaxFrameSize];
+        airclass::beginBatch(payload);
+        for (std::size_t i = begin; i < end; ++i) {
+            airclass::appendToBatch(payload, buffer, airclass::encodeFrame(frames[i], buffer));
+        }
+        return Messages{payload};
+    };
+
+    std::printf("%d gestures, bursts of %d, %s, deflate level %s\n\n", config.gestures, config.burst,
+                config.traced ? "traced" : "untraced",
+                config.level < 0 ? "default" : std::to_string(config.level).c_str());
+    std::printf("%-22s %10s %14s %14s\n", "encoding", "messages", "bytes/gesture", "ns/gesture");
+    const auto report = [&](const char* name, const Result& result) {
+        std::printf("%-22s %10llu %14.1f %14.1f\n", name, static_cast<unsigned long long>(result.messages),
+                    static_cast<double>(result.wire_bytes) / stream.size(), result.cpu_ns / stream.size());
+    };
+    report("json", run(stream, config.burst, false, config.level, encodeJson));
+    report("json+deflate", run(stream, config.burst, true, config.level, encodeJson));
+    report("binary", run(stream, config.burst, false, config.level, encodeBinary));
+    report("binary+deflate", run(stream, config.burst, true, config.level, encodeBinary));
+    report("binary batch", run(stream, config.burst, false, config.level, encodeBatch));
+    report("binary batch+deflate", run(stream, config.burst, true, config.level, encodeBatch));
+    return 0;
+}
@@ -9,14 +9,32 @@ echo "$(date): Starting Airclass parallel execution" >> $LOG_FILE
 
 /usr/bin/python3 picamhumanrec.py
 
-./server >> $LOG_FILE 2>&1 &
-SERVER_PID=$!
-
-/usr/bin/python3 use_model.py >> $LOG_FILE 2>&1 &
-MODEL_PID=$!
-
-./hardware_client >> $LOG_FILE 2>&1 &
-CLIENT_PID=$!
+# AIRCLASS_INPROCESS=1: recogniser and hardware client in one process
+# (MediapipeCpp airclass_hardware) instead of Python + pipe + hardware_client
+if [ "$AIRCLASS_INPROCESS" = "1" ] && [ -x ./airclass_hardware ]; then
+    CLIENT=airclass_hardware
+else
+    CLIENT=hardware_client
+fi
+
+# AIRCLASS_EMBEDDED_RELAY=<port>: hardware_client hosts the relay itself, so
+# no separate server process (airclass_hardware still needs one)
+if [ -z "$AIRCLASS_EMBEDDED_RELAY" ] || [ "$CLIENT" != "hardware_client" ]; then
+    ./server >> $LOG_FILE 2>&1 &
+    SERVER_PID=$!
+fi
+
+if [ "$CLIENT" = "airclass_hardware" ]; then
+    AIRCLASS_SHOW_VIDEO=0 ./airclass_hardware >> $LOG_FILE 2>&1 &
+    CLIENT_PID=$!
+    MODEL_PID=$CLIENT_PID
+else
+    /usr/bin/python3 use_model.py >> $LOG_FILE 2>&1 &
+    MODEL_PID=$!
+
+    ./hardware_client >> $LOG_FILE 2>&1 &
+    CLIENT_PID=$!
+fi
 
 # Log the PIDs
 echo "$(date): Started processes - Servo: $SERVO_PID, Server: $SERVER_PID, Model: $MODEL_PID, Client: $CLIENT_PID" >> $LOG_FILE